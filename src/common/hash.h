@@ -0,0 +1,25 @@
+// src/common/hash.h
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 64位非加密哈希（XXH64 算法），用于去重、比较和哈希表
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+// 字符串哈希
+uint64_t hash_string(const char *str);
+
+// SHA-1（用于计算 git 对象 ID）
+typedef struct {
+    uint32_t state[5];
+    uint64_t length;        // 已处理的字节数
+    unsigned char buffer[64];
+} Sha1Context;
+
+void sha1_init(Sha1Context *ctx);
+void sha1_update(Sha1Context *ctx, const void *data, size_t len);
+void sha1_final(Sha1Context *ctx, unsigned char digest[20]);
+
+#endif // HASH_H
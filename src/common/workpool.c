@@ -0,0 +1,185 @@
+// src/common/workpool.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "workpool.h"
+
+// 任务节点
+typedef struct WorkItem {
+    WorkFunc func;
+    void *arg;
+    struct WorkItem *next;
+} WorkItem;
+
+struct WorkPool {
+    pthread_t *threads;
+    int thread_count;
+    WorkItem *head;             // 队列头
+    WorkItem *tail;             // 队列尾
+    int queued;                 // 排队任务数
+    int queue_limit;            // 队列上限（0 不限制）
+    int active;                 // 正在执行的任务数
+    int shutdown;               // 退出标志
+    pthread_mutex_t lock;
+    pthread_cond_t has_work;    // 有新任务
+    pthread_cond_t has_room;    // 队列有空位
+    pthread_cond_t idle;        // 全部任务完成
+};
+
+// 工作线程参数
+typedef struct {
+    WorkPool *pool;
+    int index;
+} WorkerStart;
+
+static __thread int current_worker = -1;
+
+int workpool_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+int workpool_worker_index(void) {
+    return current_worker;
+}
+
+int workpool_size(WorkPool *pool) {
+    return pool ? pool->thread_count : 0;
+}
+
+// 工作线程主循环
+static void* worker_main(void *data) {
+    WorkerStart *start = data;
+    WorkPool *pool = start->pool;
+    current_worker = start->index;
+    free(start);
+    
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->head && !pool->shutdown) {
+            pthread_cond_wait(&pool->has_work, &pool->lock);
+        }
+        if (!pool->head && pool->shutdown) break;
+        
+        WorkItem *item = pool->head;
+        pool->head = item->next;
+        if (!pool->head) pool->tail = NULL;
+        pool->queued--;
+        pool->active++;
+        pthread_cond_signal(&pool->has_room);
+        pthread_mutex_unlock(&pool->lock);
+        
+        item->func(item->arg);
+        free(item);
+        
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        if (!pool->head && pool->active == 0) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    
+    return NULL;
+}
+
+// 创建线程池
+WorkPool* workpool_create(int threads, int queue_limit) {
+    WorkPool *pool = calloc(1, sizeof(WorkPool));
+    if (pool == NULL) return NULL;
+    
+    if (threads <= 0) threads = workpool_cpu_count();
+    pool->queue_limit = queue_limit > 0 ? queue_limit : 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->has_work, NULL);
+    pthread_cond_init(&pool->has_room, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    
+    pool->threads = malloc(sizeof(pthread_t) * threads);
+    if (pool->threads == NULL) {
+        workpool_destroy(pool);
+        return NULL;
+    }
+    
+    for (int i = 0; i < threads; i++) {
+        WorkerStart *start = malloc(sizeof(WorkerStart));
+        if (start == NULL) break;
+        start->pool = pool;
+        start->index = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, start) != 0) {
+            free(start);
+            break;
+        }
+        pool->thread_count++;
+    }
+    
+    if (pool->thread_count == 0) {
+        workpool_destroy(pool);
+        return NULL;
+    }
+    
+    return pool;
+}
+
+// 提交任务
+int workpool_submit(WorkPool *pool, WorkFunc func, void *arg) {
+    if (pool == NULL || func == NULL) return 0;
+    
+    WorkItem *item = malloc(sizeof(WorkItem));
+    if (item == NULL) return 0;
+    item->func = func;
+    item->arg = arg;
+    item->next = NULL;
+    
+    pthread_mutex_lock(&pool->lock);
+    // 池内线程提交时不阻塞，避免任务互相等待造成死锁
+    while (pool->queue_limit && pool->queued >= pool->queue_limit &&
+           current_worker < 0 && !pool->shutdown) {
+        pthread_cond_wait(&pool->has_room, &pool->lock);
+    }
+    if (pool->tail) {
+        pool->tail->next = item;
+    } else {
+        pool->head = item;
+    }
+    pool->tail = item;
+    pool->queued++;
+    pthread_cond_signal(&pool->has_work);
+    pthread_mutex_unlock(&pool->lock);
+    
+    return 1;
+}
+
+// 等待所有已提交任务完成
+void workpool_wait(WorkPool *pool) {
+    if (pool == NULL) return;
+    
+    pthread_mutex_lock(&pool->lock);
+    while (pool->head || pool->active > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// 销毁线程池（会先执行完队列中的任务）
+void workpool_destroy(WorkPool *pool) {
+    if (pool == NULL) return;
+    
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->has_work);
+    pthread_cond_broadcast(&pool->has_room);
+    pthread_mutex_unlock(&pool->lock);
+    
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->has_work);
+    pthread_cond_destroy(&pool->has_room);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,25 @@
+// src/common/workpool.h
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+// 任务函数
+typedef void (*WorkFunc)(void *arg);
+
+// 线程池（实现细节在 workpool.c 中）
+typedef struct WorkPool WorkPool;
+
+// 创建和销毁
+// threads <= 0 时使用在线CPU数；queue_limit > 0 时队列满会阻塞提交者
+WorkPool* workpool_create(int threads, int queue_limit);
+void workpool_destroy(WorkPool *pool);
+
+// 提交任务并等待全部完成
+int  workpool_submit(WorkPool *pool, WorkFunc func, void *arg);
+void workpool_wait(WorkPool *pool);
+
+// 查询
+int workpool_size(WorkPool *pool);
+int workpool_worker_index(void);   // 当前工作线程编号，非池内线程返回 -1
+int workpool_cpu_count(void);
+
+#endif // WORKPOOL_H
@@ -3,11 +3,26 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <ctype.h>
 #include <time.h>
+#include <limits.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <pthread.h>
 #include "../common/colors.h"
 #include "../common/utils.h"
+#include "../common/hash.h"
+#include "../common/workpool.h"
+
+#define DIR_DIFF_AHEAD 64       // -r 时提前交给线程池比较的文件数
+#define READ_BLOCK 65536        // 小文件比较时每次读取的字节数
+#define COMPARE_BLOCK (1024 * 1024)  // 大文件按块映射比较、块哈希的块大小
+#define BINARY_PROBE 8192       // 检查前多少字节判断是否为二进制文件
+#define STREAM_BUFFER (1024 * 1024)  // --sorted 每个输入的读缓冲区
+#define INTRALINE_MAX_LENGTH 1024    // 超过该长度的行不做行内比较
 
 // 差异类型
 typedef enum {
@@ -17,30 +32,50 @@ typedef enum {
     DIFF_CHANGE     // 修改
 } DiffType;
 
-// 差异块
+// 差异块：只记录行号范围，行内容从 FileInfo 中取
 typedef struct DiffChunk {
     DiffType type;
-    int file1_start;
+    int file1_start;    // 行号从 1 开始；该侧没有行时为此位置之前的行数
     int file1_end;
     int file2_start;
     int file2_end;
-    char **lines1;  // 文件1的行
-    char **lines2;  // 文件2的行
     int line_count1;
     int line_count2;
     struct DiffChunk *next;
 } DiffChunk;
 
+// 一行在文件内容中的位置（不含换行符）
+typedef struct {
+    size_t offset;
+    size_t length;
+} LineSpan;
+
 // 文件信息
 typedef struct {
     char *filename;
-    char **lines;
+    LineSpan *lines;
     int line_count;
-    char *content;
+    int *line_ids;      // 每行的等价类编号（规范化后相同的行编号相同）
+    char *content;      // 文件内容：mmap 映射，无法映射时为读入的缓冲区
     size_t size;
+    int mapped;
     time_t mtime;
 } FileInfo;
 
+// 差异算法
+typedef enum {
+    ALGO_MYERS,         // 默认：最短编辑脚本
+    ALGO_PATIENCE,      // 以两边都只出现一次的行为锚点
+    ALGO_HISTOGRAM      // 以出现次数最少的公共行为锚点
+} DiffAlgorithm;
+
+// 行内比较的粒度
+typedef enum {
+    INTRALINE_NONE,     // 默认：只标记整行
+    INTRALINE_WORD,     // 按词
+    INTRALINE_CHAR      // 按字符
+} IntralineMode;
+
 // 选项
 typedef struct {
     int color_output;       // 彩色输出
@@ -52,6 +87,14 @@ typedef struct {
     int show_stats;         // 显示统计
     int brief;              // 简要输出
     int recursive;          // 递归比较目录
+    int block_map;          // 二进制文件按块报告不同的区域
+    int sorted;             // 输入已排序，流式归并比较
+    int merge;              // 三方合并：基础版本 我的版本 对方版本
+    int patch;              // 输出可供 patch 使用的标准统一差异
+    int apply;              // 应用补丁：补丁文件 [目标文件]
+    int fuzz;               // 应用补丁时最多忽略的首尾上下文行数
+    DiffAlgorithm algorithm;
+    IntralineMode intraline;  // 修改块中成对的行再做一次行内比较
     int help;               // 帮助
     int version;            // 版本
 } Options;
@@ -67,6 +110,14 @@ static void init_options(Options *opts) {
     opts->show_stats = 0;
     opts->brief = 0;
     opts->recursive = 0;
+    opts->block_map = 0;
+    opts->sorted = 0;
+    opts->merge = 0;
+    opts->patch = 0;
+    opts->apply = 0;
+    opts->fuzz = 2;
+    opts->algorithm = ALGO_MYERS;
+    opts->intraline = INTRALINE_NONE;
     opts->help = 0;
     opts->version = 0;
 }
@@ -75,6 +126,8 @@ static void init_options(Options *opts) {
 static void show_help() {
     printf("tkdiff - 文件比较和合并工具\n");
     printf("用法: tkdiff [选项] 文件1 文件2\n");
+    printf("      tkdiff --merge [选项] 基础版本 我的版本 对方版本\n");
+    printf("      tkdiff --apply [选项] 补丁文件 [目标文件]\n");
     printf("选项:\n");
     printf("  -c, --context NUM  显示NUM行上下文（默认: 3）\n");
     printf("  -u, --unified      统一差异格式（默认）\n");
@@ -84,6 +137,16 @@ static void show_help() {
     printf("  -s, --stats        显示统计信息\n");
     printf("  -q, --brief        简要输出（仅报告文件是否不同）\n");
     printf("  -r, --recursive    递归比较目录\n");
+    printf("      --block-map    按 1 MB 分块报告二进制/大文件中不同的区域\n");
+    printf("      --sorted       输入已按字节序排序 (LC_ALL=C sort)，流式输出增删的行，内存占用固定\n");
+    printf("      --patience     patience 算法（以两边唯一的行为锚点，重排代码更易读）\n");
+    printf("      --histogram    histogram 算法（以出现最少的公共行为锚点）\n");
+    printf("      --merge        三方合并，结果输出到标准输出，冲突处插入冲突标记\n");
+    printf("  -p, --patch        输出标准统一差异（可用 patch 或 tkdiff --apply 应用）\n");
+    printf("      --apply        应用统一差异补丁（未指定目标文件时按补丁中的文件名）\n");
+    printf("  -F, --fuzz NUM     应用补丁时最多忽略首尾NUM行上下文（默认: 2）\n");
+    printf("      --word-diff    修改的行中突出改动的词\n");
+    printf("      --char-diff    修改的行中突出改动的字符\n");
     printf("      --no-color     无颜色输出\n");
     printf("      --help         显示帮助\n");
     printf("      --version      显示版本\n");
@@ -95,9 +158,10 @@ static void show_version() {
 }
 
 // 解析选项
-static int parse_options(int argc, char **argv, Options *opts, char **file1, char **file2) {
-    *file1 = NULL;
-    *file2 = NULL;
+static int parse_options(int argc, char **argv, Options *opts,
+                         char **file1, char **file2, char **file3) {
+    char *files[3] = {NULL, NULL, NULL};
+    int file_count = 0;
     
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--context") == 0) {
@@ -118,6 +182,28 @@ static int parse_options(int argc, char **argv, Options *opts, char **file1, cha
             opts->brief = 1;
         } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--recursive") == 0) {
             opts->recursive = 1;
+        } else if (strcmp(argv[i], "--merge") == 0) {
+            opts->merge = 1;
+        } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--patch") == 0) {
+            opts->patch = 1;
+            opts->unified_diff = 1;
+            opts->side_by_side = 0;
+        } else if (strcmp(argv[i], "--apply") == 0) {
+            opts->apply = 1;
+        } else if (strcmp(argv[i], "-F") == 0 || strcmp(argv[i], "--fuzz") == 0) {
+            if (i + 1 < argc) opts->fuzz = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sorted") == 0) {
+            opts->sorted = 1;
+        } else if (strcmp(argv[i], "--block-map") == 0) {
+            opts->block_map = 1;
+        } else if (strcmp(argv[i], "--patience") == 0) {
+            opts->algorithm = ALGO_PATIENCE;
+        } else if (strcmp(argv[i], "--histogram") == 0) {
+            opts->algorithm = ALGO_HISTOGRAM;
+        } else if (strcmp(argv[i], "--word-diff") == 0) {
+            opts->intraline = INTRALINE_WORD;
+        } else if (strcmp(argv[i], "--char-diff") == 0) {
+            opts->intraline = INTRALINE_CHAR;
         } else if (strcmp(argv[i], "--no-color") == 0) {
             opts->color_output = 0;
         } else if (strcmp(argv[i], "--help") == 0) {
@@ -130,253 +216,732 @@ static int parse_options(int argc, char **argv, Options *opts, char **file1, cha
             print_error("无效选项: %s", argv[i]);
             return -1;
         } else {
-            if (*file1 == NULL) {
-                *file1 = argv[i];
-            } else if (*file2 == NULL) {
-                *file2 = argv[i];
-            } else {
+            if (file_count == 3) {
                 print_error("多余的参数: %s", argv[i]);
                 return -1;
             }
+            files[file_count++] = argv[i];
         }
     }
     
-    if (*file1 == NULL || *file2 == NULL) {
-        print_error("需要两个文件参数");
+    int needed = opts->merge ? 3 : 2;
+    if (file_count > needed) {
+        print_error("多余的参数: %s", files[needed]);
+        return -1;
+    }
+    if (opts->apply && file_count == 0) {
+        print_error("需要补丁文件参数");
+        return -1;
+    }
+    if (!opts->apply && file_count < needed) {
+        print_error(opts->merge ? "需要三个文件参数: 基础版本 我的版本 对方版本" : "需要两个文件参数");
         return -1;
     }
     
+    *file1 = files[0];
+    *file2 = files[1];
+    *file3 = files[2];
     return 1;
 }
 
-// 读取文件内容
-static int read_file(const char *filename, FileInfo *file) {
-    file->filename = strdup(filename);
-    file->lines = NULL;
-    file->line_count = 0;
-    file->content = NULL;
-    file->size = 0;
-    
-    // 获取文件信息
-    struct stat st;
-    if (stat(filename, &st) == -1) {
-        return 0;
-    }
-    file->mtime = st.st_mtime;
+// 第 index 行（从 0 开始）的内容和长度
+static inline const char* line_text(const FileInfo *file, int index) {
+    return file->content + file->lines[index].offset;
+}
+
+static inline int line_length(const FileInfo *file, int index) {
+    return (int)file->lines[index].length;
+}
+
+// 第 index 行后面是否有换行符（只有最后一行可能没有）
+static inline int has_newline(const FileInfo *file, int index) {
+    return file->lines[index].offset + file->lines[index].length < file->size;
+}
+
+// 读入无法映射的文件（管道、设备等）
+static int read_stream(int fd, FileInfo *file) {
+    size_t capacity = 65536;
+    file->content = malloc(capacity);
+    if (file->content == NULL) return 0;
     
-    // 读取文件内容
-    if (!file_read_all(filename, &file->content, &file->size)) {
-        return 0;
+    while (1) {
+        if (file->size == capacity) {
+            capacity *= 2;
+            char *grown = realloc(file->content, capacity);
+            if (grown == NULL) return 0;
+            file->content = grown;
+        }
+        ssize_t n = read(fd, file->content + file->size, capacity - file->size);
+        if (n < 0) return 0;
+        if (n == 0) break;
+        file->size += n;
     }
+    return 1;
+}
+
+// 建立行索引：每行只记录位置，不复制内容
+static int index_lines(FileInfo *file) {
+    int capacity = 1024;
+    file->lines = malloc(sizeof(LineSpan) * capacity);
+    if (file->lines == NULL) return 0;
     
-    // 分割为行
-    char *content = file->content;
-    char *line;
-    int capacity = 16;
-    
-    file->lines = malloc(sizeof(char*) * capacity);
+    const char *p = file->content;
+    const char *end = file->content + file->size;
     
-    while ((line = strsep(&content, "\n")) != NULL) {
+    while (p < end) {
+        const char *newline = memchr(p, '\n', end - p);
+        const char *line_end = newline ? newline : end;
+        
         if (file->line_count >= capacity) {
             capacity *= 2;
-            file->lines = realloc(file->lines, sizeof(char*) * capacity);
+            LineSpan *grown = realloc(file->lines, sizeof(LineSpan) * capacity);
+            if (grown == NULL) return 0;
+            file->lines = grown;
         }
         
-        file->lines[file->line_count] = strdup(line);
+        file->lines[file->line_count].offset = p - file->content;
+        file->lines[file->line_count].length = line_end - p;
         file->line_count++;
+        
+        p = newline ? newline + 1 : end;
     }
     
     return 1;
 }
 
+// 读取文件内容：普通文件直接映射，内存中只有一份内容和一个行索引
+static int read_file(const char *filename, FileInfo *file) {
+    memset(file, 0, sizeof(*file));
+    file->filename = strdup(filename);
+    
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return 0;
+    }
+    file->mtime = st.st_mtime;
+    
+    int ok = 1;
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            file->content = map;
+            file->size = st.st_size;
+            file->mapped = 1;
+        } else {
+            ok = read_stream(fd, file);
+        }
+    } else if (!S_ISREG(st.st_mode)) {
+        ok = read_stream(fd, file);
+    }
+    close(fd);
+    
+    return ok && index_lines(file);
+}
+
 // 清理文件信息
 static void free_file_info(FileInfo *file) {
     if (file->filename) free(file->filename);
-    if (file->content) free(file->content);
+    if (file->mapped) {
+        munmap(file->content, file->size);
+    } else {
+        free(file->content);
+    }
+    free(file->lines);
+    free(file->line_ids);
+}
+
+// ========== 行等价类 ==========
+
+// 按选项规范化一行，结果写入 out（长度不超过原行），返回结果长度
+static size_t normalize_line(const char *line, size_t len, Options *opts, char *out) {
+    size_t n = 0;
+    for (size_t k = 0; k < len; k++) {
+        unsigned char c = line[k];
+        if (opts->ignore_whitespace && isspace(c)) continue;
+        out[n++] = opts->ignore_case ? tolower(c) : c;
+    }
+    return n;
+}
+
+// 等价类表中的一项
+typedef struct {
+    uint64_t hash;
+    const char *text;   // 未规范化时直接指向文件映射中的行，否则指向 arena 中的副本
+    int length;         // 与 line_length 一致
+    int id;             // 0 表示空槽
+} LineClass;
+
+// 存放规范化文本的内存块，只追加不移动，槽中的指针一直有效
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} ArenaBlock;
+
+// 两个文件共用的等价类表（开放寻址）
+typedef struct {
+    LineClass *slots;
+    size_t capacity;
+    int count;
+    ArenaBlock *arena;  // 当前块在链表头
+} LineTable;
+
+static int line_table_init(LineTable *table, int expected) {
+    table->capacity = 1024;
+    while (table->capacity < (size_t)expected * 2) table->capacity *= 2;
+    table->slots = calloc(table->capacity, sizeof(LineClass));
+    table->count = 0;
+    table->arena = NULL;
+    return table->slots != NULL;
+}
+
+static void line_table_free(LineTable *table) {
+    free(table->slots);
+    while (table->arena) {
+        ArenaBlock *next = table->arena->next;
+        free(table->arena);
+        table->arena = next;
+    }
+}
+
+// 复制一份文本到 arena，失败返回 NULL
+static const char* line_table_copy(LineTable *table, const char *text, size_t len) {
+    ArenaBlock *block = table->arena;
+    if (block == NULL || block->used + len > block->capacity) {
+        size_t capacity = len > 65536 ? len : 65536;
+        block = malloc(sizeof(ArenaBlock) + capacity);
+        if (block == NULL) return NULL;
+        block->next = table->arena;
+        block->used = 0;
+        block->capacity = capacity;
+        table->arena = block;
+    }
+    char *copy = block->data + block->used;
+    memcpy(copy, text, len);
+    block->used += len;
+    return copy;
+}
+
+static int line_table_grow(LineTable *table) {
+    size_t new_capacity = table->capacity * 2;
+    LineClass *slots = calloc(new_capacity, sizeof(LineClass));
+    if (slots == NULL) return 0;
+    
+    for (size_t k = 0; k < table->capacity; k++) {
+        if (table->slots[k].id == 0) continue;
+        size_t pos = table->slots[k].hash & (new_capacity - 1);
+        while (slots[pos].id != 0) pos = (pos + 1) & (new_capacity - 1);
+        slots[pos] = table->slots[k];
+    }
+    
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = new_capacity;
+    return 1;
+}
+
+// 查找或登记一行，返回其编号（从 1 开始，失败返回 0）
+// borrowed 表示 text 在表的生命周期内一直有效，登记时只记指针；否则复制到 arena
+static int line_table_intern(LineTable *table, const char *text, size_t len, int borrowed) {
+    if ((size_t)(table->count + 1) * 2 > table->capacity && !line_table_grow(table)) {
+        return 0;
+    }
     
-    if (file->lines) {
-        for (int i = 0; i < file->line_count; i++) {
-            free(file->lines[i]);
+    uint64_t hash = hash64(text, len, 0);
+    size_t mask = table->capacity - 1;
+    size_t pos = hash & mask;
+    
+    while (table->slots[pos].id != 0) {
+        LineClass *slot = &table->slots[pos];
+        if (slot->hash == hash && slot->length == (int)len &&
+            memcmp(slot->text, text, len) == 0) {
+            return slot->id;
         }
-        free(file->lines);
+        pos = (pos + 1) & mask;
     }
+    
+    const char *key = borrowed ? text : line_table_copy(table, text, len);
+    if (key == NULL) return 0;
+    
+    LineClass *slot = &table->slots[pos];
+    slot->hash = hash;
+    slot->text = key;
+    slot->length = (int)len;
+    slot->id = ++table->count;
+    return slot->id;
 }
 
-// 预处理行（根据选项）
-static char* preprocess_line(const char *line, Options *opts) {
-    if (!line) return strdup("");
+// 每行只规范化一次，换成等价类编号，之后的比较只比较整数
+static int intern_lines(LineTable *table, FileInfo *file, Options *opts) {
+    file->line_ids = malloc(sizeof(int) * (file->line_count > 0 ? file->line_count : 1));
+    if (file->line_ids == NULL) return 0;
     
-    char *processed = strdup(line);
+    int normalize = opts->ignore_case || opts->ignore_whitespace;
+    char *buffer = NULL;
+    size_t buffer_size = 0;
     
-    if (opts->ignore_whitespace) {
-        // 移除所有空白字符
-        char *dst = processed;
-        const char *src = processed;
+    for (int i = 0; i < file->line_count; i++) {
+        const char *line = line_text(file, i);
+        size_t len = line_length(file, i);
         
-        while (*src) {
-            if (!isspace((unsigned char)*src)) {
-                *dst++ = *src;
+        if (normalize) {
+            if (len + 1 > buffer_size) {
+                buffer_size = (len + 1) * 2;
+                char *grown = realloc(buffer, buffer_size);
+                if (grown == NULL) {
+                    free(buffer);
+                    return 0;
+                }
+                buffer = grown;
             }
-            src++;
+            len = normalize_line(line, len, opts, buffer);
+            line = buffer;
+        }
+        
+        // 不规范化时行文本就在文件映射中，表只引用不复制
+        file->line_ids[i] = line_table_intern(table, line, len, !normalize);
+        if (file->line_ids[i] == 0) {
+            free(buffer);
+            return 0;
         }
-        *dst = '\0';
     }
     
-    if (opts->ignore_case) {
-        // 转换为小写
-        for (char *p = processed; *p; p++) {
-            *p = tolower((unsigned char)*p);
+    free(buffer);
+    return 1;
+}
+
+// 缺少换行符的末行单独成一类，只与其他文件中同样缺少换行符、内容相同的末行等价，
+// 这样末尾有无换行符也算作差异；count 不超过 3
+static void separate_unterminated(FileInfo **files, int count, int *id_count) {
+    int original[3] = {0, 0, 0};
+    
+    for (int k = 0; k < count; k++) {
+        int n = files[k]->line_count;
+        if (n == 0 || has_newline(files[k], n - 1)) continue;
+        
+        original[k] = files[k]->line_ids[n - 1];
+        int id = 0;
+        for (int j = 0; j < k && id == 0; j++) {
+            if (original[j] == original[k]) id = files[j]->line_ids[files[j]->line_count - 1];
         }
+        files[k]->line_ids[n - 1] = id ? id : ++*id_count;
+    }
+}
+
+// ========== Myers O(ND) 差异算法（线性空间分治） ==========
+
+// 差异计算上下文
+typedef struct {
+    const int *ids1;        // 文件1各行的等价类编号
+    const int *ids2;
+    int *fdiag;             // 前向搜索：对角线 k 上到达的最远 x
+    int *bdiag;             // 反向搜索：对角线 k 上到达的最近 x
+    char *changed1;         // 文件1中被删除的行
+    char *changed2;         // 文件2中被插入的行
+    int too_expensive;      // 编辑距离超过该值时改用近似分割，保证大文件也能结束
+    int *count1;            // patience/histogram：区间内各等价类在文件1中的出现次数
+    int *count2;            // 同上，文件2
+    int *where1;            // 等价类在文件1区间内的位置
+} DiffContext;
+
+// 中间蛇的分割点
+typedef struct {
+    int xmid, ymid;
+    int lo_minimal;         // 前半部分是否必须求最优解
+    int hi_minimal;         // 后半部分是否必须求最优解
+} Partition;
+
+static inline int lines_equal(DiffContext *ctx, int x, int y) {
+    return ctx->ids1[x] == ctx->ids2[y];
+}
+
+// 去掉区间两端相同的行
+static void trim_common(DiffContext *ctx, int *xoff, int *xlim, int *yoff, int *ylim) {
+    while (*xoff < *xlim && *yoff < *ylim && lines_equal(ctx, *xoff, *yoff)) {
+        (*xoff)++;
+        (*yoff)++;
+    }
+    while (*xoff < *xlim && *yoff < *ylim && lines_equal(ctx, *xlim - 1, *ylim - 1)) {
+        (*xlim)--;
+        (*ylim)--;
     }
+}
+
+// 在 [xoff, xlim) x [yoff, ylim) 内同时从两端搜索，找到最短编辑路径的中点
+static void find_middle_snake(DiffContext *ctx, int xoff, int xlim, int yoff, int ylim,
+                              int find_minimal, Partition *part) {
+    int *fd = ctx->fdiag;
+    int *bd = ctx->bdiag;
+    const int dmin = xoff - ylim;
+    const int dmax = xlim - yoff;
+    const int fmid = xoff - yoff;
+    const int bmid = xlim - ylim;
+    int fmin = fmid, fmax = fmid;
+    int bmin = bmid, bmax = bmid;
+    int odd = (fmid - bmid) & 1;
     
-    return processed;
+    fd[fmid] = xoff;
+    bd[bmid] = xlim;
+    
+    for (int c = 1;; c++) {
+        // 前向扩展一步
+        if (fmin > dmin) fd[--fmin - 1] = -1; else fmin++;
+        if (fmax < dmax) fd[++fmax + 1] = -1; else fmax--;
+        for (int d = fmax; d >= fmin; d -= 2) {
+            int tlo = fd[d - 1], thi = fd[d + 1];
+            int x = tlo >= thi ? tlo + 1 : thi;
+            int y = x - d;
+            while (x < xlim && y < ylim && lines_equal(ctx, x, y)) {
+                x++;
+                y++;
+            }
+            fd[d] = x;
+            if (odd && bmin <= d && d <= bmax && bd[d] <= x) {
+                part->xmid = x;
+                part->ymid = y;
+                part->lo_minimal = part->hi_minimal = 1;
+                return;
+            }
+        }
+        
+        // 反向扩展一步
+        if (bmin > dmin) bd[--bmin - 1] = INT_MAX; else bmin++;
+        if (bmax < dmax) bd[++bmax + 1] = INT_MAX; else bmax--;
+        for (int d = bmax; d >= bmin; d -= 2) {
+            int tlo = bd[d - 1], thi = bd[d + 1];
+            int x = tlo < thi ? tlo : thi - 1;
+            int y = x - d;
+            while (xoff < x && yoff < y && lines_equal(ctx, x - 1, y - 1)) {
+                x--;
+                y--;
+            }
+            bd[d] = x;
+            if (!odd && fmin <= d && d <= fmax && x <= fd[d]) {
+                part->xmid = x;
+                part->ymid = y;
+                part->lo_minimal = part->hi_minimal = 1;
+                return;
+            }
+        }
+        
+        if (find_minimal || c < ctx->too_expensive) continue;
+        
+        // 代价过高：取前向走得最远或反向走得最远的对角线作为分割点
+        int fxybest = -1, fxbest = xoff;
+        for (int d = fmax; d >= fmin; d -= 2) {
+            int x = fd[d] < xlim ? fd[d] : xlim;
+            int y = x - d;
+            if (ylim < y) {
+                x = ylim + d;
+                y = ylim;
+            }
+            if (fxybest < x + y) {
+                fxybest = x + y;
+                fxbest = x;
+            }
+        }
+        
+        int bxybest = INT_MAX, bxbest = xlim;
+        for (int d = bmax; d >= bmin; d -= 2) {
+            int x = bd[d] > xoff ? bd[d] : xoff;
+            int y = x - d;
+            if (y < yoff) {
+                x = yoff + d;
+                y = yoff;
+            }
+            if (x + y < bxybest) {
+                bxybest = x + y;
+                bxbest = x;
+            }
+        }
+        
+        if ((xlim + ylim) - bxybest < fxybest - (xoff + yoff)) {
+            part->xmid = fxbest;
+            part->ymid = fxybest - fxbest;
+            part->lo_minimal = 1;
+            part->hi_minimal = 0;
+        } else {
+            part->xmid = bxbest;
+            part->ymid = bxybest - bxbest;
+            part->lo_minimal = 0;
+            part->hi_minimal = 1;
+        }
+        return;
+    }
 }
 
-// 比较两行
-static int compare_lines(const char *line1, const char *line2, Options *opts) {
-    if (opts->ignore_whitespace || opts->ignore_case) {
-        char *proc1 = preprocess_line(line1, opts);
-        char *proc2 = preprocess_line(line2, opts);
-        int result = strcmp(proc1, proc2);
-        free(proc1);
-        free(proc2);
-        return result == 0;
+// 比较 [xoff, xlim) 与 [yoff, ylim)，把不在公共子序列中的行标记出来
+static void compare_sequences(DiffContext *ctx, int xoff, int xlim, int yoff, int ylim,
+                              int find_minimal) {
+    trim_common(ctx, &xoff, &xlim, &yoff, &ylim);
+    
+    if (xoff == xlim) {
+        while (yoff < ylim) ctx->changed2[yoff++] = 1;
+    } else if (yoff == ylim) {
+        while (xoff < xlim) ctx->changed1[xoff++] = 1;
     } else {
-        return strcmp(line1, line2) == 0;
+        Partition part;
+        find_middle_snake(ctx, xoff, xlim, yoff, ylim, find_minimal, &part);
+        compare_sequences(ctx, xoff, part.xmid, yoff, part.ymid, part.lo_minimal);
+        compare_sequences(ctx, part.xmid, xlim, part.ymid, ylim, part.hi_minimal);
     }
 }
 
-// 查找最长公共子序列（简化版）
-static int** compute_lcs(FileInfo *file1, FileInfo *file2, Options *opts) {
-    int m = file1->line_count;
-    int n = file2->line_count;
+// ========== patience / histogram ==========
+
+#define HISTOGRAM_MAX_CHAIN 64  // 公共行出现次数超过该值时不作为锚点
+
+// patience 锚点：两边各出现一次的行
+typedef struct {
+    int x, y;
+} Anchor;
+
+// patience：取两边各只出现一次的行，按最长递增子序列选出互不交叉的锚点，
+// 锚点之间递归处理，找不到锚点时交给 Myers
+static void diff_patience(DiffContext *ctx, int xoff, int xlim, int yoff, int ylim) {
+    trim_common(ctx, &xoff, &xlim, &yoff, &ylim);
+    if (xoff == xlim || yoff == ylim) {
+        compare_sequences(ctx, xoff, xlim, yoff, ylim, 0);
+        return;
+    }
+    
+    for (int x = xoff; x < xlim; x++) {
+        ctx->count1[ctx->ids1[x]]++;
+        ctx->where1[ctx->ids1[x]] = x;
+    }
+    for (int y = yoff; y < ylim; y++) {
+        ctx->count2[ctx->ids2[y]]++;
+    }
     
-    // 分配二维数组
-    int **lcs = malloc((m + 1) * sizeof(int*));
-    for (int i = 0; i <= m; i++) {
-        lcs[i] = malloc((n + 1) * sizeof(int));
-        for (int j = 0; j <= n; j++) {
-            lcs[i][j] = 0;
+    // 按文件2中的顺序收集
+    int limit = (xlim - xoff) < (ylim - yoff) ? (xlim - xoff) : (ylim - yoff);
+    Anchor *anchors = malloc(sizeof(Anchor) * limit);
+    int count = 0;
+    for (int y = yoff; anchors && y < ylim; y++) {
+        int id = ctx->ids2[y];
+        if (ctx->count1[id] == 1 && ctx->count2[id] == 1) {
+            anchors[count].x = ctx->where1[id];
+            anchors[count].y = y;
+            count++;
         }
     }
     
-    // 计算LCS
-    for (int i = 1; i <= m; i++) {
-        for (int j = 1; j <= n; j++) {
-            if (compare_lines(file1->lines[i-1], file2->lines[j-1], opts)) {
-                lcs[i][j] = lcs[i-1][j-1] + 1;
-            } else {
-                lcs[i][j] = (lcs[i-1][j] > lcs[i][j-1]) ? lcs[i-1][j] : lcs[i][j-1];
+    for (int x = xoff; x < xlim; x++) ctx->count1[ctx->ids1[x]] = 0;
+    for (int y = yoff; y < ylim; y++) ctx->count2[ctx->ids2[y]] = 0;
+    
+    // 在 x 上求最长递增子序列（patience 排序）
+    int *tails = malloc(sizeof(int) * (count > 0 ? count : 1));
+    int *prev = malloc(sizeof(int) * (count > 0 ? count : 1));
+    int length = 0;
+    if (count == 0 || tails == NULL || prev == NULL) {
+        free(anchors);
+        free(tails);
+        free(prev);
+        compare_sequences(ctx, xoff, xlim, yoff, ylim, 0);
+        return;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        int lo = 0, hi = length;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (anchors[tails[mid]].x < anchors[i].x) lo = mid + 1; else hi = mid;
+        }
+        prev[i] = lo > 0 ? tails[lo - 1] : -1;
+        tails[lo] = i;
+        if (lo == length) length++;
+    }
+    
+    Anchor *chain = malloc(sizeof(Anchor) * length);
+    if (chain == NULL) {
+        free(anchors);
+        free(tails);
+        free(prev);
+        compare_sequences(ctx, xoff, xlim, yoff, ylim, 0);
+        return;
+    }
+    for (int i = tails[length - 1], k = length - 1; i >= 0; i = prev[i], k--) {
+        chain[k] = anchors[i];
+    }
+    free(anchors);
+    free(tails);
+    free(prev);
+    
+    int px = xoff, py = yoff;
+    for (int k = 0; k < length; k++) {
+        diff_patience(ctx, px, chain[k].x, py, chain[k].y);
+        px = chain[k].x + 1;
+        py = chain[k].y + 1;
+    }
+    free(chain);
+    diff_patience(ctx, px, xlim, py, ylim);
+}
+
+// histogram：取文件1中出现次数最少的公共行作锚点，向两边扩展成相同区域，
+// 左侧递归、右侧继续循环；公共行都太常见时交给 Myers
+static void diff_histogram(DiffContext *ctx, int xoff, int xlim, int yoff, int ylim) {
+    while (1) {
+        trim_common(ctx, &xoff, &xlim, &yoff, &ylim);
+        if (xoff == xlim || yoff == ylim) break;
+        
+        // 倒序统计，where1 留下的是第一次出现的位置
+        for (int x = xlim - 1; x >= xoff; x--) {
+            ctx->count1[ctx->ids1[x]]++;
+            ctx->where1[ctx->ids1[x]] = x;
+        }
+        
+        int best_count = HISTOGRAM_MAX_CHAIN + 1;
+        int bx = -1, by = -1;
+        for (int y = yoff; y < ylim && best_count > 1; y++) {
+            int c = ctx->count1[ctx->ids2[y]];
+            if (c > 0 && c < best_count) {
+                best_count = c;
+                bx = ctx->where1[ctx->ids2[y]];
+                by = y;
             }
         }
+        
+        for (int x = xoff; x < xlim; x++) ctx->count1[ctx->ids1[x]] = 0;
+        if (by < 0) break;
+        
+        int sx = bx, sy = by;
+        while (sx > xoff && sy > yoff && lines_equal(ctx, sx - 1, sy - 1)) {
+            sx--;
+            sy--;
+        }
+        int ex = bx + 1, ey = by + 1;
+        while (ex < xlim && ey < ylim && lines_equal(ctx, ex, ey)) {
+            ex++;
+            ey++;
+        }
+        
+        diff_histogram(ctx, xoff, sx, yoff, sy);
+        xoff = ex;
+        yoff = ey;
     }
     
-    return lcs;
+    compare_sequences(ctx, xoff, xlim, yoff, ylim, 0);
+}
+
+// 追加一个差异块；start1/start2 为块前已处理的行数
+static void append_chunk(DiffChunk **head, DiffChunk **tail, DiffType type,
+                         int start1, int count1, int start2, int count2) {
+    DiffChunk *chunk = malloc(sizeof(DiffChunk));
+    chunk->type = type;
+    chunk->next = NULL;
+    
+    // 行号从 1 开始；某一侧为空时记录该位置之前的行数
+    chunk->file1_start = count1 > 0 ? start1 + 1 : start1;
+    chunk->file1_end = start1 + count1;
+    chunk->file2_start = count2 > 0 ? start2 + 1 : start2;
+    chunk->file2_end = start2 + count2;
+    
+    // 相同块只计文件1一侧的行数
+    chunk->line_count1 = count1;
+    chunk->line_count2 = type == DIFF_EQUAL ? 0 : count2;
+    
+    if (*tail) {
+        (*tail)->next = chunk;
+    } else {
+        *head = chunk;
+    }
+    *tail = chunk;
 }
 
-// 提取差异
-static DiffChunk* extract_diff(FileInfo *file1, FileInfo *file2, int **lcs, Options *opts) {
-    int i = file1->line_count;
-    int j = file2->line_count;
+// 计算差异，按文件顺序返回相同/删除/插入/修改块；id_count 为等价类数量
+static DiffChunk* compute_diff(FileInfo *file1, FileInfo *file2, int id_count, Options *opts) {
+    int m = file1->line_count;
+    int n = file2->line_count;
+    
+    DiffContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.ids1 = file1->line_ids;
+    ctx.ids2 = file2->line_ids;
+    
+    // 先去掉相同的开头和结尾，后面的算法和内存都只针对中间部分
+    int xoff = 0, xlim = m, yoff = 0, ylim = n;
+    trim_common(&ctx, &xoff, &xlim, &yoff, &ylim);
+    int m2 = xlim - xoff;
+    int n2 = ylim - yoff;
+    
+    // 对角线编号范围为 [xoff-ylim-1, xlim-yoff+1]
+    int diags = m2 + n2 + 3;
+    int *fdiag = malloc(sizeof(int) * diags * 2);
+    ctx.changed1 = calloc(m + 1, 1);
+    ctx.changed2 = calloc(n + 1, 1);
+    if (opts->algorithm != ALGO_MYERS) {
+        ctx.count1 = calloc(id_count + 1, sizeof(int));
+        ctx.count2 = calloc(id_count + 1, sizeof(int));
+        ctx.where1 = calloc(id_count + 1, sizeof(int));
+    }
+    if (fdiag == NULL || ctx.changed1 == NULL || ctx.changed2 == NULL ||
+        (opts->algorithm != ALGO_MYERS &&
+         (ctx.count1 == NULL || ctx.count2 == NULL || ctx.where1 == NULL))) {
+        free(fdiag);
+        free(ctx.changed1);
+        free(ctx.changed2);
+        free(ctx.count1);
+        free(ctx.count2);
+        free(ctx.where1);
+        return NULL;
+    }
+    ctx.fdiag = fdiag + n2 - xoff + yoff + 1;
+    ctx.bdiag = ctx.fdiag + diags;
+    
+    // 大约为 sqrt(m+n) 的量级，至少 4096
+    ctx.too_expensive = 1;
+    for (int d = diags; d != 0; d >>= 2) {
+        ctx.too_expensive <<= 1;
+    }
+    if (ctx.too_expensive < 4096) ctx.too_expensive = 4096;
+    
+    if (opts->algorithm == ALGO_PATIENCE) {
+        diff_patience(&ctx, xoff, xlim, yoff, ylim);
+    } else if (opts->algorithm == ALGO_HISTOGRAM) {
+        diff_histogram(&ctx, xoff, xlim, yoff, ylim);
+    } else {
+        compare_sequences(&ctx, xoff, xlim, yoff, ylim, 0);
+    }
+    free(fdiag);
+    free(ctx.count1);
+    free(ctx.count2);
+    free(ctx.where1);
+    
+    // 把标记转换为差异块
     DiffChunk *head = NULL;
     DiffChunk *tail = NULL;
+    int i = 0, j = 0;
     
-    while (i > 0 || j > 0) {
-        DiffChunk *chunk = malloc(sizeof(DiffChunk));
-        chunk->next = NULL;
-        
-        if (i > 0 && j > 0 && compare_lines(file1->lines[i-1], file2->lines[j-1], opts)) {
-            // 行相同
-            chunk->type = DIFF_EQUAL;
-            chunk->file1_start = chunk->file1_end = i;
-            chunk->file2_start = chunk->file2_end = j;
-            chunk->lines1 = malloc(sizeof(char*));
-            chunk->lines1[0] = strdup(file1->lines[i-1]);
-            chunk->line_count1 = 1;
-            chunk->lines2 = NULL;
-            chunk->line_count2 = 0;
-            i--;
-            j--;
-        } else if (j > 0 && (i == 0 || lcs[i][j-1] >= lcs[i-1][j])) {
-            // 文件2有插入
-            chunk->type = DIFF_INSERT;
-            chunk->file1_start = chunk->file1_end = i;
-            chunk->file2_start = chunk->file2_end = j;
-            chunk->lines1 = NULL;
-            chunk->line_count1 = 0;
-            chunk->lines2 = malloc(sizeof(char*));
-            chunk->lines2[0] = strdup(file2->lines[j-1]);
-            chunk->line_count2 = 1;
-            j--;
-        } else if (i > 0 && (j == 0 || lcs[i][j-1] < lcs[i-1][j])) {
-            // 文件1有删除
-            chunk->type = DIFF_DELETE;
-            chunk->file1_start = chunk->file1_end = i;
-            chunk->file2_start = chunk->file2_end = j;
-            chunk->lines1 = malloc(sizeof(char*));
-            chunk->lines1[0] = strdup(file1->lines[i-1]);
-            chunk->line_count1 = 1;
-            chunk->lines2 = NULL;
-            chunk->line_count2 = 0;
-            i--;
-        }
-        
-        // 合并相邻的相同类型块
-        if (tail && tail->type == chunk->type) {
-            if (chunk->type == DIFF_EQUAL || chunk->type == DIFF_INSERT || chunk->type == DIFF_DELETE) {
-                // 扩展前一个块
-                if (chunk->type == DIFF_EQUAL) {
-                    tail->file1_start = chunk->file1_start;
-                    tail->file2_start = chunk->file2_start;
-                    
-                    char **new_lines = malloc(sizeof(char*) * (tail->line_count1 + 1));
-                    for (int k = 0; k < tail->line_count1; k++) {
-                        new_lines[k] = tail->lines1[k];
-                    }
-                    new_lines[tail->line_count1] = chunk->lines1[0];
-                    free(tail->lines1);
-                    tail->lines1 = new_lines;
-                    tail->line_count1++;
-                } else if (chunk->type == DIFF_INSERT) {
-                    tail->file2_start = chunk->file2_start;
-                    
-                    char **new_lines = malloc(sizeof(char*) * (tail->line_count2 + 1));
-                    for (int k = 0; k < tail->line_count2; k++) {
-                        new_lines[k] = tail->lines2[k];
-                    }
-                    new_lines[tail->line_count2] = chunk->lines2[0];
-                    free(tail->lines2);
-                    tail->lines2 = new_lines;
-                    tail->line_count2++;
-                } else if (chunk->type == DIFF_DELETE) {
-                    tail->file1_start = chunk->file1_start;
-                    
-                    char **new_lines = malloc(sizeof(char*) * (tail->line_count1 + 1));
-                    for (int k = 0; k < tail->line_count1; k++) {
-                        new_lines[k] = tail->lines1[k];
-                    }
-                    new_lines[tail->line_count1] = chunk->lines1[0];
-                    free(tail->lines1);
-                    tail->lines1 = new_lines;
-                    tail->line_count1++;
-                }
-                
-                free(chunk->lines1);
-                free(chunk->lines2);
-                free(chunk);
-                continue;
-            }
+    while (i < m || j < n) {
+        int i0 = i, j0 = j;
+        while (i < m && j < n && !ctx.changed1[i] && !ctx.changed2[j]) {
+            i++;
+            j++;
+        }
+        if (i > i0) {
+            append_chunk(&head, &tail, DIFF_EQUAL, i0, i - i0, j0, j - j0);
+            continue;
         }
         
-        // 添加到链表
-        if (head == NULL) {
-            head = tail = chunk;
-        } else {
-            chunk->next = head;
-            head = chunk;
+        // 紧挨着的删除和插入合并为一个修改块
+        while (i < m && ctx.changed1[i]) i++;
+        while (j < n && ctx.changed2[j]) j++;
+        if (i > i0 && j > j0) {
+            append_chunk(&head, &tail, DIFF_CHANGE, i0, i - i0, j0, j - j0);
+        } else if (i > i0) {
+            append_chunk(&head, &tail, DIFF_DELETE, i0, i - i0, j0, 0);
+        } else if (j > j0) {
+            append_chunk(&head, &tail, DIFF_INSERT, i0, 0, j0, j - j0);
         }
     }
     
+    free(ctx.changed1);
+    free(ctx.changed2);
     return head;
 }
 
@@ -384,24 +949,233 @@ static DiffChunk* extract_diff(FileInfo *file1, FileInfo *file2, int **lcs, Opti
 static void free_diff_chunks(DiffChunk *head) {
     while (head) {
         DiffChunk *next = head->next;
+        free(head);
+        head = next;
+    }
+}
+
+// 差异中是否只有相同块（-i/-w 时内容不同的文件也可能等价）
+static int diff_is_empty(DiffChunk *diff) {
+    for (DiffChunk *c = diff; c; c = c->next) {
+        if (c->type != DIFF_EQUAL) return 0;
+    }
+    return 1;
+}
+
+// 一处改动：文件1 [start1, end1) 换成文件2 [start2, end2)，行号从 0 开始
+typedef struct {
+    int start1, end1;
+    int start2, end2;
+} DiffHunk;
+
+// 把差异块中的非相同块转换为改动列表
+static DiffHunk* collect_hunks(DiffChunk *diff, int *count) {
+    int capacity = 0;
+    for (DiffChunk *c = diff; c; c = c->next) {
+        if (c->type != DIFF_EQUAL) capacity++;
+    }
+    
+    DiffHunk *hunks = malloc(sizeof(DiffHunk) * (capacity > 0 ? capacity : 1));
+    *count = 0;
+    if (hunks == NULL) return NULL;
+    
+    for (DiffChunk *c = diff; c; c = c->next) {
+        if (c->type == DIFF_EQUAL) continue;
+        DiffHunk *h = &hunks[(*count)++];
+        h->start1 = c->file1_end - c->line_count1;
+        h->end1 = c->file1_end;
+        h->start2 = c->file2_end - c->line_count2;
+        h->end2 = c->file2_end;
+    }
+    return hunks;
+}
+
+// ========== 行内差异 ==========
+
+// 下一个词元的字节数
+// 按词：连续的字母数字下划线、连续的空白、一个多字节字符或一个标点各算一个词元
+// 按字符：一个 UTF-8 字符
+static size_t token_length(const char *s, size_t len, IntralineMode mode) {
+    unsigned char c = s[0];
+    size_t n = 1;
+    
+    if (c >= 0x80) {
+        while (n < len && ((unsigned char)s[n] & 0xC0) == 0x80) n++;
+        return n;
+    }
+    if (mode == INTRALINE_CHAR) return 1;
+    
+    if (isalnum(c) || c == '_') {
+        while (n < len && (isalnum((unsigned char)s[n]) || s[n] == '_')) n++;
+    } else if (isspace(c)) {
+        while (n < len && isspace((unsigned char)s[n])) n++;
+    }
+    return n;
+}
+
+// 把一行切成词元并登记等价类，返回词元数（失败返回 -1）
+// starts 记录各词元的起始位置，末尾多记一项行长
+static int tokenize_line(LineTable *table, const char *line, size_t len, Options *opts,
+                         char *buffer, int *ids, int *starts) {
+    int count = 0;
+    size_t pos = 0;
+    
+    while (pos < len) {
+        size_t n = token_length(line + pos, len - pos, opts->intraline);
+        if (opts->ignore_case || opts->ignore_whitespace) {
+            size_t key_len = normalize_line(line + pos, n, opts, buffer);
+            ids[count] = line_table_intern(table, buffer, key_len, 0);
+        } else {
+            ids[count] = line_table_intern(table, line + pos, n, 1);
+        }
+        if (ids[count] == 0) return -1;
+        starts[count++] = (int)pos;
+        pos += n;
+    }
+    starts[count] = (int)len;
+    return count;
+}
+
+// 对一对修改的行按词元再跑一次 Myers，把改动词元的字节在 marks1/marks2 中置 1
+// 行过长、两行没有公共的非空白词元或内存不足时返回 0，按整行显示
+static int diff_line_pair(const char *a, int alen, const char *b, int blen, Options *opts,
+                          char *marks1, char *marks2) {
+    if (alen > INTRALINE_MAX_LENGTH || blen > INTRALINE_MAX_LENGTH) return 0;
+    
+    LineTable table;
+    if (!line_table_init(&table, alen + blen)) return 0;
+    
+    // 词元数不超过字节数，按字节数分配即可
+    int diags = alen + blen + 3;
+    int *ints = malloc(sizeof(int) * ((alen + 1) * 2 + (blen + 1) * 2 + diags * 2));
+    char *bytes = calloc((alen > blen ? alen : blen) + alen + blen + 3, 1);
+    int result = 0;
+    
+    if (ints && bytes) {
+        int *ids1 = ints;
+        int *starts1 = ids1 + alen + 1;
+        int *ids2 = starts1 + alen + 1;
+        int *starts2 = ids2 + blen + 1;
+        int *fdiag = starts2 + blen + 1;
+        char *changed1 = bytes;
+        char *changed2 = changed1 + alen + 1;
+        char *buffer = changed2 + blen + 1;
+        
+        int n1 = tokenize_line(&table, a, alen, opts, buffer, ids1, starts1);
+        int n2 = tokenize_line(&table, b, blen, opts, buffer, ids2, starts2);
         
-        if (head->lines1) {
-            for (int i = 0; i < head->line_count1; i++) {
-                free(head->lines1[i]);
+        if (n1 >= 0 && n2 >= 0) {
+            DiffContext ctx;
+            memset(&ctx, 0, sizeof(ctx));
+            ctx.ids1 = ids1;
+            ctx.ids2 = ids2;
+            ctx.fdiag = fdiag + n2 + 1;
+            ctx.bdiag = ctx.fdiag + diags;
+            ctx.changed1 = changed1;
+            ctx.changed2 = changed2;
+            ctx.too_expensive = 4096;
+            compare_sequences(&ctx, 0, n1, 0, n2, 1);
+            
+            // 只有空白相同的两行，逐词标记反而更乱
+            for (int k = 0; k < n1 && !result; k++) {
+                if (!changed1[k] && !isspace((unsigned char)a[starts1[k]])) result = 1;
+            }
+            for (int k = 0; result && k < n1; k++) {
+                memset(marks1 + starts1[k], changed1[k], starts1[k + 1] - starts1[k]);
+            }
+            for (int k = 0; result && k < n2; k++) {
+                memset(marks2 + starts2[k], changed2[k], starts2[k + 1] - starts2[k]);
             }
-            free(head->lines1);
         }
+    }
+    
+    free(ints);
+    free(bytes);
+    line_table_free(&table);
+    return result;
+}
+
+// 为修改块中成对的行（第 k 个旧行对第 k 个新行）计算行内标记
+// 返回 2 * pairs 个数组，前一半对应旧行、后一半对应新行，未比较的行为 NULL；
+// 未启用行内比较或不是修改块时返回 NULL
+static char** chunk_marks(FileInfo *file1, FileInfo *file2, DiffChunk *chunk, Options *opts,
+                          int *pairs) {
+    *pairs = 0;
+    if (opts->intraline == INTRALINE_NONE || chunk->type != DIFF_CHANGE) return NULL;
+    
+    int count = chunk->line_count1 < chunk->line_count2 ? chunk->line_count1 : chunk->line_count2;
+    char **marks = calloc(count * 2, sizeof(char*));
+    if (marks == NULL) return NULL;
+    *pairs = count;
+    
+    for (int k = 0; k < count; k++) {
+        int index1 = chunk->file1_start - 1 + k;
+        int index2 = chunk->file2_start - 1 + k;
+        int len1 = line_length(file1, index1);
+        int len2 = line_length(file2, index2);
+        char *marks1 = malloc(len1 + 1);
+        char *marks2 = malloc(len2 + 1);
         
-        if (head->lines2) {
-            for (int i = 0; i < head->line_count2; i++) {
-                free(head->lines2[i]);
-            }
-            free(head->lines2);
+        if (marks1 && marks2 &&
+            diff_line_pair(line_text(file1, index1), len1, line_text(file2, index2), len2,
+                           opts, marks1, marks2)) {
+            marks[k] = marks1;
+            marks[count + k] = marks2;
+        } else {
+            free(marks1);
+            free(marks2);
         }
+    }
+    return marks;
+}
+
+static void free_chunk_marks(char **marks, int pairs) {
+    if (marks == NULL) return;
+    for (int k = 0; k < pairs * 2; k++) free(marks[k]);
+    free(marks);
+}
+
+// 输出 text 中至多 *room 个字节（room 为 NULL 时不限）
+static void put_clipped(const char *text, int len, int *room) {
+    if (room) {
+        if (len > *room) len = *room;
+        *room -= len;
+    }
+    fwrite(text, 1, len, stdout);
+}
+
+// 输出一行内容，marks 中标记的字节反色显示；无颜色时删除侧用 [-…-]、插入侧用 {+…+} 括起
+// width >= 0 时最多输出 width 个可见字节，返回实际输出的可见字节数
+static int print_marked(const char *text, int len, const char *marks, int insert,
+                        const char *color, Options *opts, int width) {
+    int room = width;
+    int *limit = width >= 0 ? &room : NULL;
+    int use_color = opts->color_output && color;
+    
+    if (use_color) printf("%s", color);
+    
+    int pos = 0;
+    while (pos < len && (limit == NULL || room > 0)) {
+        int marked = marks ? marks[pos] : 0;
+        int end = pos + 1;
+        while (end < len && (marks ? marks[end] : 0) == marked) end++;
         
-        free(head);
-        head = next;
+        if (!marked) {
+            put_clipped(text + pos, end - pos, limit);
+        } else if (use_color) {
+            printf("%s", STYLE_REVERSE);
+            put_clipped(text + pos, end - pos, limit);
+            printf("%s%s", COLOR_RESET, color);
+        } else {
+            put_clipped(insert ? "{+" : "[-", 2, limit);
+            put_clipped(text + pos, end - pos, limit);
+            put_clipped(insert ? "+}" : "-]", 2, limit);
+        }
+        pos = end;
     }
+    
+    if (use_color) printf("%s", COLOR_RESET);
+    return width >= 0 ? width - room : len;
 }
 
 // 显示统一格式差异
@@ -442,50 +1216,120 @@ static void show_unified_diff(FileInfo *file1, FileInfo *file2,
             printf("@@ -%d,%d +%d,%d @@\n", start1, count1, start2, count2);
         }
         
-        // 显示行
-        int i = 0, j = 0;
-        while (i < count1 || j < count2) {
-            char prefix = ' ';
-            const char *color = NULL;
-            const char *line = NULL;
-            
-            if (i < count1 && j < count2) {
-                // 修改
-                prefix = '!';
-                color = COLOR_BRIGHT_YELLOW;
-                line = current->lines1[i];
-                i++;
-            } else if (i < count1) {
-                // 删除
-                prefix = '-';
-                color = COLOR_BRIGHT_RED;
-                line = current->lines1[i];
-                i++;
-            } else if (j < count2) {
-                // 插入
-                prefix = '+';
-                color = COLOR_BRIGHT_GREEN;
-                line = current->lines2[j];
-                j++;
-            }
+        // 显示行：修改块先列出旧行再列出新行
+        int pairs;
+        char **marks = chunk_marks(file1, file2, current, opts, &pairs);
+        for (int k = 0; k < count1 + count2; k++) {
+            int insert = k >= count1;
+            const FileInfo *file = insert ? file2 : file1;
+            int index = insert ? start2 - 1 + k - count1 : start1 - 1 + k;
+            int pair = insert ? k - count1 : k;
+            const char *line_marks = pair < pairs ? marks[insert ? pairs + pair : pair] : NULL;
+            const char *color = insert ? COLOR_BRIGHT_GREEN : COLOR_BRIGHT_RED;
             
-            if (opts->color_output && color) {
-                printf("%s%c %s%s\n", color, prefix, line, COLOR_RESET);
+            if (opts->color_output) {
+                printf("%s%c ", color, insert ? '+' : '-');
             } else {
-                printf("%c %s\n", prefix, line);
+                printf("%c ", insert ? '+' : '-');
             }
+            print_marked(line_text(file, index), line_length(file, index), line_marks, insert,
+                         color, opts, -1);
+            printf("\n");
+            if (!has_newline(file, index)) printf("\\ No newline at end of file\n");
         }
+        free_chunk_marks(marks, pairs);
         
         current = current->next;
     }
 }
 
-// 显示并排差异
-static void show_side_by_side_diff(FileInfo *file1, FileInfo *file2, 
-                                  DiffChunk *diff, Options *opts) {
-    int width = 40;
-    
-    // 标题
+// ========== 补丁输出 ==========
+
+// 统一差异的行范围：count 为 0 时 start 为范围之前的行号
+static void print_patch_range(int start, int count) {
+    if (count == 1) {
+        printf("%d", start + 1);
+    } else {
+        printf("%d,%d", count > 0 ? start + 1 : start, count);
+    }
+}
+
+static void print_patch_line(char prefix, const FileInfo *file, int index) {
+    printf("%c%.*s\n", prefix, line_length(file, index), line_text(file, index));
+    if (!has_newline(file, index)) {
+        printf("\\ No newline at end of file\n");
+    }
+}
+
+// 输出标准统一差异：相距不超过 2 * 上下文行数的改动合并为一个块
+static void show_patch(FileInfo *file1, FileInfo *file2, DiffChunk *diff, Options *opts) {
+    int count;
+    DiffHunk *hunks = collect_hunks(diff, &count);
+    if (hunks == NULL) {
+        print_error("内存分配失败");
+        return;
+    }
+    if (count == 0) {
+        free(hunks);
+        return;
+    }
+    
+    char time1[64], time2[64];
+    strftime(time1, sizeof(time1), "%Y-%m-%d %H:%M:%S %z", localtime(&file1->mtime));
+    strftime(time2, sizeof(time2), "%Y-%m-%d %H:%M:%S %z", localtime(&file2->mtime));
+    printf("--- %s\t%s\n", file1->filename, time1);
+    printf("+++ %s\t%s\n", file2->filename, time2);
+    
+    int context = opts->context_lines > 0 ? opts->context_lines : 0;
+    int first = 0;
+    while (first < count) {
+        int last = first;
+        while (last + 1 < count && hunks[last + 1].start1 - hunks[last].end1 <= context * 2) {
+            last++;
+        }
+        
+        int lo1 = hunks[first].start1 - context;
+        if (lo1 < 0) lo1 = 0;
+        int hi1 = hunks[last].end1 + context;
+        if (hi1 > file1->line_count) hi1 = file1->line_count;
+        int lo2 = hunks[first].start2 - (hunks[first].start1 - lo1);
+        int hi2 = hunks[last].end2 + (hi1 - hunks[last].end1);
+        
+        printf("@@ -");
+        print_patch_range(lo1, hi1 - lo1);
+        printf(" +");
+        print_patch_range(lo2, hi2 - lo2);
+        printf(" @@\n");
+        
+        int pos = lo1;
+        for (int k = first; k <= last; k++) {
+            for (; pos < hunks[k].start1; pos++) print_patch_line(' ', file1, pos);
+            for (int i = hunks[k].start1; i < hunks[k].end1; i++) print_patch_line('-', file1, i);
+            for (int j = hunks[k].start2; j < hunks[k].end2; j++) print_patch_line('+', file2, j);
+            pos = hunks[k].end1;
+        }
+        for (; pos < hi1; pos++) print_patch_line(' ', file1, pos);
+        
+        first = last + 1;
+    }
+    
+    free(hunks);
+}
+
+// 取一行的前 width 个字节（过长截断）
+static void copy_column(char *out, const FileInfo *file, int index, int width) {
+    int len = line_length(file, index);
+    if (len > width) len = width;
+    memcpy(out, line_text(file, index), len);
+    out[len] = '\0';
+}
+
+// 显示并排差异
+static void show_side_by_side_diff(FileInfo *file1, FileInfo *file2, 
+                                  DiffChunk *diff, Options *opts) {
+    int width = 40;
+    
+    // 标题
     if (opts->color_output) {
         color_print(COLOR_BRIGHT_CYAN, "%-*s | %-*s\n", width, file1->filename, width, file2->filename);
         for (int i = 0; i < width * 2 + 3; i++) printf("═");
@@ -507,10 +1351,8 @@ static void show_side_by_side_diff(FileInfo *file1, FileInfo *file2,
                 char line2_str[width + 1];
                 
                 // 截断过长的行
-                strncpy(line1_str, current->lines1[i], width);
-                line1_str[width] = '\0';
-                strncpy(line2_str, current->lines1[i], width);
-                line2_str[width] = '\0';
+                copy_column(line1_str, file1, current->file1_start - 1 + i, width);
+                copy_column(line2_str, file2, current->file2_start - 1 + i, width);
                 
                 if (opts->color_output) {
                     printf("%s%-*s %s| %-*s%s\n", 
@@ -527,8 +1369,7 @@ static void show_side_by_side_diff(FileInfo *file1, FileInfo *file2,
             // 只显示在文件1中
             for (int i = 0; i < current->line_count1; i++) {
                 char line_str[width + 1];
-                strncpy(line_str, current->lines1[i], width);
-                line_str[width] = '\0';
+                copy_column(line_str, file1, current->file1_start - 1 + i, width);
                 
                 if (opts->color_output) {
                     printf("%s%-*s %s| %-*s%s\n", 
@@ -544,8 +1385,7 @@ static void show_side_by_side_diff(FileInfo *file1, FileInfo *file2,
             // 只显示在文件2中
             for (int i = 0; i < current->line_count2; i++) {
                 char line_str[width + 1];
-                strncpy(line_str, current->lines2[i], width);
-                line_str[width] = '\0';
+                copy_column(line_str, file2, current->file2_start - 1 + i, width);
                 
                 if (opts->color_output) {
                     printf("%s%-*s %s| %s%-*s%s\n", 
@@ -558,6 +1398,35 @@ static void show_side_by_side_diff(FileInfo *file1, FileInfo *file2,
                 
                 line2++;
             }
+        } else if (current->type == DIFF_CHANGE) {
+            // 左右逐行对照，成对的行突出行内改动
+            int pairs;
+            char **marks = chunk_marks(file1, file2, current, opts, &pairs);
+            int rows = current->line_count1 > current->line_count2 ?
+                       current->line_count1 : current->line_count2;
+            
+            for (int k = 0; k < rows; k++) {
+                int shown = 0;
+                if (k < current->line_count1) {
+                    int index = current->file1_start - 1 + k;
+                    shown = print_marked(line_text(file1, index), line_length(file1, index),
+                                         k < pairs ? marks[k] : NULL, 0,
+                                         COLOR_BRIGHT_RED, opts, width);
+                    line1++;
+                }
+                printf("%*s | ", width - shown, "");
+                
+                shown = 0;
+                if (k < current->line_count2) {
+                    int index = current->file2_start - 1 + k;
+                    shown = print_marked(line_text(file2, index), line_length(file2, index),
+                                         k < pairs ? marks[pairs + k] : NULL, 1,
+                                         COLOR_BRIGHT_GREEN, opts, width);
+                    line2++;
+                }
+                printf("%*s\n", width - shown, "");
+            }
+            free_chunk_marks(marks, pairs);
         }
         
         current = current->next;
@@ -646,72 +1515,1506 @@ static void show_stats(FileInfo *file1, FileInfo *file2, DiffChunk *diff, Option
 }
 
 // 简要输出
-static void show_brief(FileInfo *file1, FileInfo *file2, DiffChunk *diff, Options *opts) {
-    int inserts, deletes, changes;
-    compute_stats(diff, &inserts, &deletes, &changes);
-    
-    if (inserts == 0 && deletes == 0 && changes == 0) {
+static void show_brief(const char *path1, const char *path2, int same, Options *opts) {
+    if (same) {
         if (opts->color_output) {
-            color_println(COLOR_BRIGHT_GREEN, "文件 %s 和 %s 相同", file1->filename, file2->filename);
+            color_println(COLOR_BRIGHT_GREEN, "文件 %s 和 %s 相同", path1, path2);
         } else {
-            printf("文件 %s 和 %s 相同\n", file1->filename, file2->filename);
+            printf("文件 %s 和 %s 相同\n", path1, path2);
         }
     } else {
         if (opts->color_output) {
-            color_println(COLOR_BRIGHT_YELLOW, "文件 %s 和 %s 不同", file1->filename, file2->filename);
+            color_println(COLOR_BRIGHT_YELLOW, "文件 %s 和 %s 不同", path1, path2);
         } else {
-            printf("文件 %s 和 %s 不同\n", file1->filename, file2->filename);
+            printf("文件 %s 和 %s 不同\n", path1, path2);
         }
     }
 }
 
-// 比较两个文件
-static int compare_files(const char *file1_path, const char *file2_path, Options *opts) {
-    FileInfo file1, file2;
+// ========== 快速内容比较 ==========
+
+// 读满 size 字节（文件被截短时返回实际读到的字节数）
+static size_t read_block(int fd, char *buffer, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = read(fd, buffer + total, size - total);
+        if (n <= 0) break;
+        total += n;
+    }
+    return total;
+}
+
+// 第一个不同字节在块内的位置
+static size_t first_mismatch(const char *a, const char *b, size_t size) {
+    size_t k = 0;
+    while (k < size && a[k] == b[k]) k++;
+    return k;
+}
+
+// 比较两个文件的内容：返回 1 相同，0 不同，-1 无法读取
+// 大小不同且不需要偏移时直接返回；否则 *first_diff 为第一个不同字节的偏移
+// 小文件分块读取；大文件整体映射，按 1 MB 分块 memcmp，遇到不同立即停止
+static int compare_contents(const char *path1, const char *path2, off_t size1, off_t size2,
+                            int want_offset, off_t *first_diff) {
+    *first_diff = -1;
+    if (size1 != size2 && !want_offset) return 0;
+    
+    off_t common = size1 < size2 ? size1 : size2;
+    if (common == 0) {
+        *first_diff = 0;
+        return size1 == size2;
+    }
+    
+    int fd1 = open(path1, O_RDONLY);
+    int fd2 = open(path2, O_RDONLY);
+    if (fd1 < 0 || fd2 < 0) {
+        if (fd1 >= 0) close(fd1);
+        if (fd2 >= 0) close(fd2);
+        return -1;
+    }
     
-    if (!read_file(file1_path, &file1)) {
-        print_error("无法读取文件: %s", file1_path);
+    int result = -1;
+    off_t offset = 0;
+    
+    if (common < COMPARE_BLOCK) {
+        char *buffer = malloc(READ_BLOCK * 2);
+        result = buffer ? 1 : -1;
+        while (buffer && offset < common) {
+            size_t want = common - offset < READ_BLOCK ? common - offset : READ_BLOCK;
+            size_t n1 = read_block(fd1, buffer, want);
+            size_t n2 = read_block(fd2, buffer + READ_BLOCK, want);
+            size_t n = n1 < n2 ? n1 : n2;
+            if (memcmp(buffer, buffer + READ_BLOCK, n) != 0 || n < want) {
+                offset += first_mismatch(buffer, buffer + READ_BLOCK, n);
+                result = 0;
+                break;
+            }
+            offset += n;
+        }
+        free(buffer);
+    } else {
+        char *map1 = mmap(NULL, common, PROT_READ, MAP_PRIVATE, fd1, 0);
+        char *map2 = mmap(NULL, common, PROT_READ, MAP_PRIVATE, fd2, 0);
+        if (map1 != MAP_FAILED && map2 != MAP_FAILED) {
+            madvise(map1, common, MADV_SEQUENTIAL);
+            madvise(map2, common, MADV_SEQUENTIAL);
+            result = 1;
+            while (offset < common) {
+                size_t n = common - offset < COMPARE_BLOCK ? common - offset : COMPARE_BLOCK;
+                if (memcmp(map1 + offset, map2 + offset, n) != 0) {
+                    offset += first_mismatch(map1 + offset, map2 + offset, n);
+                    result = 0;
+                    break;
+                }
+                offset += n;
+            }
+        }
+        if (map1 != MAP_FAILED) munmap(map1, common);
+        if (map2 != MAP_FAILED) munmap(map2, common);
+    }
+    
+    close(fd1);
+    close(fd2);
+    
+    // 公共部分相同但大小不同：第一个不同的位置就是较短文件的末尾
+    if (result == 1 && size1 != size2) result = 0;
+    if (result == 0) *first_diff = offset;
+    return result;
+}
+
+// 前 BINARY_PROBE 字节中含有 '\0' 视为二进制文件
+static int is_binary_file(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    char buffer[BINARY_PROBE];
+    size_t n = read_block(fd, buffer, sizeof(buffer));
+    close(fd);
+    return memchr(buffer, '\0', n) != NULL;
+}
+
+// 二进制文件的比较结果
+static void show_binary_result(const char *path1, const char *path2, int same,
+                               off_t first_diff, Options *opts) {
+    if (same) {
+        printf("二进制文件 %s 和 %s 相同\n", path1, path2);
+        return;
+    }
+    if (opts->color_output) {
+        color_print(COLOR_BRIGHT_YELLOW, "二进制文件 %s 和 %s 不同", path1, path2);
+    } else {
+        printf("二进制文件 %s 和 %s 不同", path1, path2);
+    }
+    if (first_diff >= 0) {
+        printf("（第一个不同的字节在偏移 %lld）", (long long)first_diff);
+    }
+    printf("\n");
+}
+
+// 一个文件的分块哈希，两个文件在两个线程上同时计算
+typedef struct {
+    const char *path;
+    off_t size;
+    uint64_t *hashes;
+    size_t count;
+    int ok;
+} BlockHashTask;
+
+static void compute_block_hashes(void *arg) {
+    BlockHashTask *task = arg;
+    task->count = (task->size + COMPARE_BLOCK - 1) / COMPARE_BLOCK;
+    task->hashes = malloc(sizeof(uint64_t) * (task->count > 0 ? task->count : 1));
+    if (task->hashes == NULL || task->size == 0) {
+        task->ok = task->hashes != NULL;
+        return;
+    }
+    
+    int fd = open(task->path, O_RDONLY);
+    if (fd < 0) return;
+    char *map = mmap(NULL, task->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return;
+    
+    madvise(map, task->size, MADV_SEQUENTIAL);
+    for (size_t b = 0; b < task->count; b++) {
+        off_t offset = (off_t)b * COMPARE_BLOCK;
+        size_t n = task->size - offset < COMPARE_BLOCK ? task->size - offset : COMPARE_BLOCK;
+        task->hashes[b] = hash64(map + offset, n, 0);
+        // 已经比较过的部分不再需要留在页缓存映射中
+        madvise(map + offset, n, MADV_DONTNEED);
+    }
+    munmap(map, task->size);
+    task->ok = 1;
+}
+
+// --block-map：列出哈希不同的 1 MB 块，相邻的块合并为一个区域
+static void show_block_map(const char *path1, const char *path2, off_t size1, off_t size2) {
+    BlockHashTask tasks[2] = {
+        {path1, size1, NULL, 0, 0},
+        {path2, size2, NULL, 0, 0}
+    };
+    
+    WorkPool *pool = workpool_create(2, 0);
+    for (int t = 0; t < 2; t++) {
+        if (pool == NULL || !workpool_submit(pool, compute_block_hashes, &tasks[t])) {
+            compute_block_hashes(&tasks[t]);
+        }
+    }
+    workpool_wait(pool);
+    workpool_destroy(pool);
+    
+    if (!tasks[0].ok || !tasks[1].ok) {
+        print_error("无法计算块哈希");
+        free(tasks[0].hashes);
+        free(tasks[1].hashes);
+        return;
+    }
+    
+    size_t blocks = tasks[0].count > tasks[1].count ? tasks[0].count : tasks[1].count;
+    size_t differing = 0;
+    printf("不同的区域（按 %d MB 分块）:\n", COMPARE_BLOCK / (1024 * 1024));
+    
+    for (size_t b = 0; b < blocks; ) {
+        int same = b < tasks[0].count && b < tasks[1].count &&
+                   tasks[0].hashes[b] == tasks[1].hashes[b];
+        if (same) {
+            b++;
+            continue;
+        }
+        
+        size_t start = b;
+        while (b < blocks && !(b < tasks[0].count && b < tasks[1].count &&
+                               tasks[0].hashes[b] == tasks[1].hashes[b])) {
+            b++;
+        }
+        differing += b - start;
+        
+        long long from = (long long)start * COMPARE_BLOCK;
+        long long to = (long long)b * COMPARE_BLOCK;
+        long long limit = size1 > size2 ? size1 : size2;
+        if (to > limit) to = limit;
+        printf("  0x%010llx - 0x%010llx  (%s)\n", from, to, format_size(to - from));
+    }
+    
+    printf("共 %zu 块，其中 %zu 块不同\n", blocks, differing);
+    free(tasks[0].hashes);
+    free(tasks[1].hashes);
+}
+
+// --brief、二进制文件和 --block-map 不需要逐行比较
+static int compare_files_fast(const char *path1, const char *path2, int binary, Options *opts) {
+    struct stat st1, st2;
+    if (stat(path1, &st1) == -1 || stat(path2, &st2) == -1) {
+        print_error("无法读取文件: %s", stat(path1, &st1) == -1 ? path1 : path2);
         return 1;
     }
     
-    if (!read_file(file2_path, &file2)) {
-        print_error("无法读取文件: %s", file2_path);
-        free_file_info(&file1);
+    off_t first_diff = -1;
+    int result;
+    if (st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino) {
+        result = 1;
+    } else {
+        result = compare_contents(path1, path2, st1.st_size, st2.st_size, !opts->brief, &first_diff);
+    }
+    if (result < 0) {
+        print_error("无法读取文件: %s 或 %s", path1, path2);
         return 1;
     }
     
-    // 计算LCS
-    int **lcs = compute_lcs(&file1, &file2, opts);
+    if (opts->brief) {
+        show_brief(path1, path2, result, opts);
+    } else if (binary) {
+        show_binary_result(path1, path2, result, first_diff, opts);
+    }
     
-    // 提取差异
-    DiffChunk *diff = extract_diff(&file1, &file2, lcs, opts);
+    if (opts->block_map && result == 0) {
+        show_block_map(path1, path2, st1.st_size, st2.st_size);
+    }
+    
+    return 0;
+}
+
+// ========== --sorted 流式归并比较 ==========
+
+// 按行读取的输入流：当前行只在下一次读取前有效
+typedef struct {
+    const char *path;
+    int fd;
+    char *buffer;
+    size_t capacity;
+    size_t start;           // 未处理数据的起点
+    size_t end;
+    int eof;
+    const char *line;       // 当前行（不含换行符）
+    size_t length;
+    const char *key;        // 比较用的键：-i/-w 时为规范化后的行
+    size_t key_length;
+    char *scratch;          // 规范化缓冲区
+    size_t scratch_capacity;
+    char *prev;             // 上一行的键，用于检查排序
+    size_t prev_length;
+    size_t prev_capacity;
+    int has_line;
+    int unsorted_warned;
+} LineStream;
+
+static int line_stream_open(LineStream *ls, const char *path) {
+    memset(ls, 0, sizeof(*ls));
+    ls->path = path;
+    ls->fd = open(path, O_RDONLY);
+    if (ls->fd < 0) return 0;
+    
+    // 顺序读取提示，让内核对两个输入同时预读
+    posix_fadvise(ls->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    ls->capacity = STREAM_BUFFER;
+    ls->buffer = malloc(ls->capacity);
+    return ls->buffer != NULL;
+}
+
+static void line_stream_close(LineStream *ls) {
+    if (ls->fd >= 0) close(ls->fd);
+    free(ls->buffer);
+    free(ls->scratch);
+    free(ls->prev);
+}
+
+static int ensure_capacity(char **buffer, size_t *capacity, size_t need) {
+    if (need <= *capacity) return 1;
+    size_t new_capacity = *capacity ? *capacity : 256;
+    while (new_capacity < need) new_capacity *= 2;
+    char *grown = realloc(*buffer, new_capacity);
+    if (grown == NULL) return 0;
+    *buffer = grown;
+    *capacity = new_capacity;
+    return 1;
+}
+
+// 读取下一行；返回 0 表示结束
+static int line_stream_next(LineStream *ls, Options *opts) {
+    // 记下上一行的键，检查输入是否有序
+    if (ls->has_line) {
+        if (!ensure_capacity(&ls->prev, &ls->prev_capacity, ls->key_length + 1)) return 0;
+        memcpy(ls->prev, ls->key, ls->key_length);
+        ls->prev_length = ls->key_length;
+    }
+    
+    while (1) {
+        char *newline = memchr(ls->buffer + ls->start, '\n', ls->end - ls->start);
+        if (newline || (ls->eof && ls->end > ls->start)) {
+            char *line_end = newline ? newline : ls->buffer + ls->end;
+            ls->line = ls->buffer + ls->start;
+            ls->length = line_end - ls->line;
+            ls->start = newline ? (size_t)(newline - ls->buffer) + 1 : ls->end;
+            break;
+        }
+        if (ls->eof) {
+            ls->has_line = 0;
+            return 0;
+        }
+        
+        // 把剩余部分移到开头再读；一行比缓冲区还长时扩大缓冲区
+        size_t remaining = ls->end - ls->start;
+        memmove(ls->buffer, ls->buffer + ls->start, remaining);
+        ls->start = 0;
+        ls->end = remaining;
+        if (ls->end == ls->capacity &&
+            !ensure_capacity(&ls->buffer, &ls->capacity, ls->capacity * 2)) {
+            ls->has_line = 0;
+            return 0;
+        }
+        ssize_t n = read(ls->fd, ls->buffer + ls->end, ls->capacity - ls->end);
+        if (n <= 0) {
+            ls->eof = 1;
+        } else {
+            ls->end += n;
+        }
+    }
+    
+    if (opts->ignore_case || opts->ignore_whitespace) {
+        if (!ensure_capacity(&ls->scratch, &ls->scratch_capacity, ls->length + 1)) return 0;
+        ls->key_length = normalize_line(ls->line, ls->length, opts, ls->scratch);
+        ls->key = ls->scratch;
+    } else {
+        ls->key = ls->line;
+        ls->key_length = ls->length;
+    }
+    
+    int had_line = ls->has_line;
+    ls->has_line = 1;
+    
+    if (had_line && !ls->unsorted_warned) {
+        size_t n = ls->prev_length < ls->key_length ? ls->prev_length : ls->key_length;
+        int cmp = memcmp(ls->prev, ls->key, n);
+        if (cmp > 0 || (cmp == 0 && ls->prev_length > ls->key_length)) {
+            print_warning("%s 未按顺序排序，结果可能不正确", ls->path);
+            ls->unsorted_warned = 1;
+        }
+    }
+    return 1;
+}
+
+// 按字节序比较两个当前行的键
+static int compare_stream_keys(const LineStream *a, const LineStream *b) {
+    size_t n = a->key_length < b->key_length ? a->key_length : b->key_length;
+    int cmp = memcmp(a->key, b->key, n);
+    if (cmp != 0) return cmp;
+    return a->key_length < b->key_length ? -1 : (a->key_length > b->key_length ? 1 : 0);
+}
+
+static void emit_stream_line(char prefix, const LineStream *ls, Options *opts) {
+    const char *color = prefix == '-' ? COLOR_BRIGHT_RED : COLOR_BRIGHT_GREEN;
+    if (opts->color_output) fputs(color, stdout);
+    putchar(prefix);
+    putchar(' ');
+    fwrite(ls->line, 1, ls->length, stdout);
+    if (opts->color_output) fputs(COLOR_RESET, stdout);
+    putchar('\n');
+}
+
+// 两个已排序输入的归并比较：只需各自的当前行，内存与文件大小无关
+static int compare_sorted(const char *path1, const char *path2, Options *opts) {
+    LineStream a, b;
+    int ok1 = line_stream_open(&a, path1);
+    int ok2 = line_stream_open(&b, path2);
+    if (!ok1 || !ok2) {
+        print_error("无法读取文件: %s", ok1 ? path2 : path1);
+        line_stream_close(&a);
+        line_stream_close(&b);
+        return 1;
+    }
+    
+    int show_lines = !opts->brief && !opts->show_stats;
+    if (show_lines) {
+        if (opts->color_output) {
+            color_print(COLOR_BRIGHT_CYAN, "--- ");
+            printf("%s\n", path1);
+            color_print(COLOR_BRIGHT_CYAN, "+++ ");
+            printf("%s\n", path2);
+        } else {
+            printf("--- %s\n+++ %s\n", path1, path2);
+        }
+    }
+    
+    long long removed = 0, added = 0;
+    line_stream_next(&a, opts);
+    line_stream_next(&b, opts);
+    
+    while (a.has_line || b.has_line) {
+        int cmp = !a.has_line ? 1 : !b.has_line ? -1 : compare_stream_keys(&a, &b);
+        
+        if (cmp == 0) {
+            line_stream_next(&a, opts);
+            line_stream_next(&b, opts);
+            continue;
+        }
+        
+        if (cmp < 0) {
+            removed++;
+            if (show_lines) emit_stream_line('-', &a, opts);
+            line_stream_next(&a, opts);
+        } else {
+            added++;
+            if (show_lines) emit_stream_line('+', &b, opts);
+            line_stream_next(&b, opts);
+        }
+        
+        // -q 只需知道是否不同
+        if (opts->brief) break;
+    }
     
-    // 显示结果
     if (opts->brief) {
-        show_brief(&file1, &file2, diff, opts);
+        show_brief(path1, path2, removed == 0 && added == 0, opts);
+    } else if (opts->show_stats) {
+        printf("文件1: %s\n文件2: %s\n", path1, path2);
+        if (removed == 0 && added == 0) {
+            printf("✅ 文件完全相同\n");
+        } else {
+            printf("➕ 插入: %lld 行\n", added);
+            printf("➖ 删除: %lld 行\n", removed);
+        }
+    }
+    
+    line_stream_close(&a);
+    line_stream_close(&b);
+    return 0;
+}
+
+// 读取两个文件并计算差异
+// 返回 0 成功，1/2 表示对应文件无法读取，3 表示内存不足；不输出错误，便于在工作线程中调用
+static int diff_files(const char *path1, const char *path2, Options *opts,
+                      FileInfo *file1, FileInfo *file2, DiffChunk **diff) {
+    *diff = NULL;
+    int ok1 = read_file(path1, file1);
+    int ok2 = read_file(path2, file2);
+    if (!ok1 || !ok2) return ok1 ? 2 : 1;
+    
+    // 两个文件的行换成共用的等价类编号
+    LineTable table;
+    int interned = line_table_init(&table, file1->line_count + file2->line_count) &&
+                   intern_lines(&table, file1, opts) &&
+                   intern_lines(&table, file2, opts);
+    int id_count = table.count;
+    line_table_free(&table);
+    if (!interned) return 3;
+    
+    FileInfo *files[2] = {file1, file2};
+    separate_unterminated(files, 2, &id_count);
+    
+    // 计算差异
+    *diff = compute_diff(file1, file2, id_count, opts);
+    return 0;
+}
+
+static void report_diff_error(int error, const char *path1, const char *path2) {
+    if (error == 1 || error == 2) {
+        print_error("无法读取文件: %s", error == 1 ? path1 : path2);
+    } else if (error == 3) {
+        print_error("内存分配失败");
+    }
+}
+
+// 按选项显示结果
+static void show_result(FileInfo *file1, FileInfo *file2, DiffChunk *diff, Options *opts) {
+    if (opts->patch) {
+        show_patch(file1, file2, diff, opts);
     } else if (opts->show_stats) {
-        show_stats(&file1, &file2, diff, opts);
+        show_stats(file1, file2, diff, opts);
     } else if (opts->side_by_side) {
-        show_side_by_side_diff(&file1, &file2, diff, opts);
+        show_side_by_side_diff(file1, file2, diff, opts);
     } else {
-        show_unified_diff(&file1, &file2, diff, opts);
+        show_unified_diff(file1, file2, diff, opts);
     }
+}
+
+// 比较两个文件
+static int compare_files(const char *file1_path, const char *file2_path, Options *opts) {
+    FileInfo file1, file2;
+    DiffChunk *diff;
     
-    // 清理
-    for (int i = 0; i <= file1.line_count; i++) {
-        free(lcs[i]);
+    // -i/-w 时字节不同的文本文件也可能等价，-q 也要按行比较
+    int normalize = opts->ignore_case || opts->ignore_whitespace;
+    int binary = is_binary_file(file1_path) || is_binary_file(file2_path);
+    if ((opts->brief && !normalize) || binary || opts->block_map) {
+        return compare_files_fast(file1_path, file2_path, binary, opts);
     }
-    free(lcs);
+    
+    int error = diff_files(file1_path, file2_path, opts, &file1, &file2, &diff);
+    if (error == 0 && opts->brief) {
+        show_brief(file1_path, file2_path, diff_is_empty(diff), opts);
+    } else if (error == 0) {
+        show_result(&file1, &file2, diff, opts);
+    } else {
+        report_diff_error(error, file1_path, file2_path);
+    }
+    
+    // 清理
     free_diff_chunks(diff);
     free_file_info(&file1);
     free_file_info(&file2);
     
+    return error == 0 ? 0 : 1;
+}
+
+// ========== 三方合并 ==========
+
+// 结束上一行：*open 表示已输出的最后一行没有换行符
+static void close_line(int *open) {
+    if (*open) putchar('\n');
+    *open = 0;
+}
+
+// 原样输出 [from, to) 行（含换行符）；缺少换行符的行只有后面还有输出时才补上
+static void emit_lines(const FileInfo *file, int from, int to, int *open) {
+    for (int i = from; i < to; i++) {
+        int newline = has_newline(file, i);
+        close_line(open);
+        fwrite(line_text(file, i), 1, line_length(file, i) + newline, stdout);
+        *open = !newline;
+    }
+}
+
+// 两侧 [lo1, hi1) 与 [lo2, hi2) 的行是否逐行等价
+static int same_lines(const FileInfo *file1, int lo1, int hi1,
+                      const FileInfo *file2, int lo2, int hi2) {
+    if (hi1 - lo1 != hi2 - lo2) return 0;
+    for (int k = 0; k < hi1 - lo1; k++) {
+        if (file1->line_ids[lo1 + k] != file2->line_ids[lo2 + k]) return 0;
+    }
+    return 1;
+}
+
+// 按 diff3 的方式合并：把基础版本上重叠或相邻的改动归为一组，
+// 只有一侧改动的组直接采用该侧，两侧改成一样的也直接采用，否则输出冲突标记。
+// 返回冲突数
+static int merge_hunks(const FileInfo *base, const FileInfo *mine, const FileInfo *theirs,
+                       const DiffHunk *a, int na, const DiffHunk *b, int nb) {
+    int pos = 0;                    // 基础版本中已输出到的行
+    int delta_a = 0, delta_b = 0;   // 组之前两侧相对基础版本的行数差
+    int i = 0, j = 0;
+    int conflicts = 0;
+    int open = 0;
+    
+    while (i < na || j < nb) {
+        int lo;
+        if (j >= nb || (i < na && a[i].start1 <= b[j].start1)) {
+            lo = a[i].start1;
+        } else {
+            lo = b[j].start1;
+        }
+        
+        // 吸收与当前组重叠或相接的改动，直到两侧都没有新的改动加入
+        int hi = lo;
+        int first_a = i, first_b = j;
+        int a_lo = lo + delta_a, b_lo = lo + delta_b;
+        for (;;) {
+            if (i < na && a[i].start1 <= hi) {
+                if (a[i].end1 > hi) hi = a[i].end1;
+                delta_a += (a[i].end2 - a[i].start2) - (a[i].end1 - a[i].start1);
+                i++;
+            } else if (j < nb && b[j].start1 <= hi) {
+                if (b[j].end1 > hi) hi = b[j].end1;
+                delta_b += (b[j].end2 - b[j].start2) - (b[j].end1 - b[j].start1);
+                j++;
+            } else {
+                break;
+            }
+        }
+        int a_hi = hi + delta_a, b_hi = hi + delta_b;
+        
+        emit_lines(base, pos, lo, &open);
+        pos = hi;
+        
+        if (j == first_b || (i > first_a && same_lines(mine, a_lo, a_hi, theirs, b_lo, b_hi))) {
+            emit_lines(mine, a_lo, a_hi, &open);
+        } else if (i == first_a) {
+            emit_lines(theirs, b_lo, b_hi, &open);
+        } else {
+            close_line(&open);
+            printf("<<<<<<< %s\n", mine->filename);
+            emit_lines(mine, a_lo, a_hi, &open);
+            close_line(&open);
+            printf("||||||| %s\n", base->filename);
+            emit_lines(base, lo, hi, &open);
+            close_line(&open);
+            printf("=======\n");
+            emit_lines(theirs, b_lo, b_hi, &open);
+            close_line(&open);
+            printf(">>>>>>> %s\n", theirs->filename);
+            conflicts++;
+        }
+    }
+    
+    emit_lines(base, pos, base->line_count, &open);
+    return conflicts;
+}
+
+// 三方合并：基础版本分别与两侧比较，合并结果写到标准输出
+// 返回 0 无冲突，1 有冲突或出错
+static int merge_files(const char *base_path, const char *mine_path, const char *theirs_path,
+                       Options *opts) {
+    FileInfo base, mine, theirs;
+    const char *paths[3] = {base_path, mine_path, theirs_path};
+    FileInfo *files[3] = {&base, &mine, &theirs};
+    int result = 1;
+    
+    int read_ok = 1;
+    for (int k = 0; k < 3; k++) {
+        if (!read_file(paths[k], files[k])) {
+            print_error("无法读取文件: %s", paths[k]);
+            read_ok = 0;
+        }
+    }
+    
+    // 三个文件共用一张等价类表，之后的比较都只比较整数
+    DiffChunk *diff_a = NULL, *diff_b = NULL;
+    DiffHunk *hunks_a = NULL, *hunks_b = NULL;
+    int na = 0, nb = 0;
+    int ok = 0;
+    
+    if (read_ok) {
+        LineTable table;
+        ok = line_table_init(&table, base.line_count + mine.line_count + theirs.line_count) &&
+             intern_lines(&table, &base, opts) &&
+             intern_lines(&table, &mine, opts) &&
+             intern_lines(&table, &theirs, opts);
+        int id_count = table.count;
+        line_table_free(&table);
+        // 没有换行符的末行与同内容的普通行不等价
+        if (ok) separate_unterminated(files, 3, &id_count);
+        
+        if (ok) {
+            diff_a = compute_diff(&base, &mine, id_count, opts);
+            diff_b = compute_diff(&base, &theirs, id_count, opts);
+            hunks_a = collect_hunks(diff_a, &na);
+            hunks_b = collect_hunks(diff_b, &nb);
+            ok = hunks_a && hunks_b;
+        }
+        if (!ok) print_error("内存分配失败");
+    }
+    
+    if (ok) {
+        int conflicts = merge_hunks(&base, &mine, &theirs, hunks_a, na, hunks_b, nb);
+        if (conflicts > 0) {
+            // 标准输出是合并结果，提示写到标准错误
+            fprintf(stderr, "[警告] %d 处冲突\n", conflicts);
+        }
+        result = conflicts > 0 ? 1 : 0;
+    }
+    
+    free(hunks_a);
+    free(hunks_b);
+    free_diff_chunks(diff_a);
+    free_diff_chunks(diff_b);
+    for (int k = 0; k < 3; k++) free_file_info(files[k]);
+    return result;
+}
+
+// ========== 应用补丁 ==========
+
+// 补丁块中的一行：' ' 上下文，'-' 删除，'+' 插入
+typedef struct {
+    char type;
+    const char *text;
+    int length;
+    int no_newline;     // 后面跟着 "\ No newline at end of file"
+} PatchLine;
+
+// 补丁块；lines 指向所在文件段的 PatchLine 数组
+typedef struct {
+    int old_start, old_count;
+    int new_start, new_count;
+    int first;          // 第一行在 PatchLine 数组中的位置
+    int count;
+} PatchHunk;
+
+// 补丁中一个文件的所有块
+typedef struct {
+    char *old_name;
+    char *new_name;
+    int old_epoch;      // 时间戳是 1970-01-01（diff -N 表示该侧文件不存在）
+    int new_epoch;
+    PatchLine *lines;
+    int line_count, line_capacity;
+    PatchHunk *hunks;
+    int hunk_count, hunk_capacity;
+} PatchSection;
+
+static int line_starts_with(const FileInfo *file, int index, const char *prefix) {
+    size_t len = strlen(prefix);
+    return (size_t)line_length(file, index) >= len &&
+           memcmp(line_text(file, index), prefix, len) == 0;
+}
+
+// 取 "--- 文件名\t时间" 中的文件名
+static char* patch_file_name(const FileInfo *patch, int index) {
+    const char *name = line_text(patch, index) + 4;
+    int len = line_length(patch, index) - 4;
+    const char *tab = memchr(name, '\t', len);
+    if (tab) len = tab - name;
+    while (len > 0 && (name[len - 1] == ' ' || name[len - 1] == '\r')) len--;
+    return strndup(name, len);
+}
+
+// "--- 文件名\t时间" 中的时间是否为 1970-01-01（按 UTC 写出）
+static int patch_time_is_epoch(const FileInfo *patch, int index) {
+    const char *text = line_text(patch, index);
+    int len = line_length(patch, index);
+    const char *tab = memchr(text, '\t', len);
+    if (tab == NULL) return 0;
+    size_t rest = len - (tab + 1 - text);
+    return rest >= 19 && memcmp(tab + 1, "1970-01-01 00:00:00", 19) == 0;
+}
+
+static void free_patch_section(PatchSection *section) {
+    free(section->old_name);
+    free(section->new_name);
+    free(section->lines);
+    free(section->hunks);
+    memset(section, 0, sizeof(*section));
+}
+
+// 解析 "@@ -a,b +c,d @@"，省略的行数为 1
+static int parse_hunk_header(const FileInfo *patch, int index, PatchHunk *hunk) {
+    char header[128];
+    int len = line_length(patch, index);
+    if (len > (int)sizeof(header) - 1) len = sizeof(header) - 1;
+    memcpy(header, line_text(patch, index), len);
+    header[len] = '\0';
+    
+    const char *p = header + 3;
+    char *end;
+    if (*p++ != '-') return 0;
+    hunk->old_start = strtol(p, &end, 10);
+    hunk->old_count = *end == ',' ? strtol(end + 1, &end, 10) : 1;
+    if (end[0] != ' ' || end[1] != '+') return 0;
+    hunk->new_start = strtol(end + 2, &end, 10);
+    hunk->new_count = *end == ',' ? strtol(end + 1, &end, 10) : 1;
+    return *end == ' ';
+}
+
+// 从第 *index 行开始读取一个文件段的所有块，返回 0 表示补丁格式错误
+static int parse_patch_section(const FileInfo *patch, int *index, PatchSection *section) {
+    int i = *index;
+    section->old_name = patch_file_name(patch, i);
+    section->new_name = patch_file_name(patch, i + 1);
+    section->old_epoch = patch_time_is_epoch(patch, i);
+    section->new_epoch = patch_time_is_epoch(patch, i + 1);
+    i += 2;
+    
+    while (i < patch->line_count && line_starts_with(patch, i, "@@ ")) {
+        if (section->hunk_count == section->hunk_capacity) {
+            section->hunk_capacity = section->hunk_capacity ? section->hunk_capacity * 2 : 16;
+            PatchHunk *grown = realloc(section->hunks, sizeof(PatchHunk) * section->hunk_capacity);
+            if (grown == NULL) return 0;
+            section->hunks = grown;
+        }
+        PatchHunk *hunk = &section->hunks[section->hunk_count];
+        if (!parse_hunk_header(patch, i, hunk)) {
+            print_error("%s: 第 %d 行块头格式错误", patch->filename, i + 1);
+            return 0;
+        }
+        hunk->first = section->line_count;
+        hunk->count = 0;
+        i++;
+        
+        // 按块头中的行数读取，两边都读够为止
+        int old_left = hunk->old_count, new_left = hunk->new_count;
+        while (i < patch->line_count && (old_left > 0 || new_left > 0)) {
+            const char *text = line_text(patch, i);
+            int len = line_length(patch, i);
+            char type = len > 0 ? text[0] : ' ';    // 有的编辑器会去掉空上下文行的前导空格
+            
+            if (type == '\\') {
+                if (hunk->count > 0) section->lines[section->line_count - 1].no_newline = 1;
+                i++;
+                continue;
+            }
+            if (type != ' ' && type != '-' && type != '+') break;
+            if ((type != '+' && old_left == 0) || (type != '-' && new_left == 0)) break;
+            if (type != '+') old_left--;
+            if (type != '-') new_left--;
+            
+            if (section->line_count == section->line_capacity) {
+                section->line_capacity = section->line_capacity ? section->line_capacity * 2 : 256;
+                PatchLine *grown = realloc(section->lines, sizeof(PatchLine) * section->line_capacity);
+                if (grown == NULL) return 0;
+                section->lines = grown;
+            }
+            PatchLine *line = &section->lines[section->line_count++];
+            line->type = type;
+            line->text = len > 0 ? text + 1 : text;
+            line->length = len > 0 ? len - 1 : 0;
+            line->no_newline = 0;
+            hunk->count++;
+            i++;
+        }
+        if (old_left > 0 || new_left > 0) {
+            print_error("%s: 第 %d 个块不完整", patch->filename, section->hunk_count + 1);
+            return 0;
+        }
+        
+        // 块最后一行的 "\ No newline at end of file"
+        if (i < patch->line_count && line_starts_with(patch, i, "\\") && hunk->count > 0) {
+            section->lines[section->line_count - 1].no_newline = 1;
+            i++;
+        }
+        section->hunk_count++;
+    }
+    
+    *index = i;
+    return 1;
+}
+
+// 块中旧文件一侧（上下文和删除行）从第 skip 个起、共 count 行是否与目标文件从 pos 起的行相同
+static int hunk_matches(const FileInfo *file, int pos, const PatchSection *section,
+                        const PatchHunk *hunk, int skip, int count) {
+    int seen = 0;
+    for (int k = 0; k < hunk->count && count > 0; k++) {
+        const PatchLine *line = &section->lines[hunk->first + k];
+        if (line->type == '+') continue;
+        if (seen++ < skip) continue;
+        if (line_length(file, pos) != line->length ||
+            memcmp(line_text(file, pos), line->text, line->length) != 0) {
+            return 0;
+        }
+        pos++;
+        count--;
+    }
+    return 1;
+}
+
+// 块开头、结尾的上下文行数
+static void hunk_context(const PatchSection *section, const PatchHunk *hunk, int *lead, int *trail) {
+    *lead = *trail = 0;
+    while (*lead < hunk->count && section->lines[hunk->first + *lead].type == ' ') (*lead)++;
+    while (*trail < hunk->count - *lead &&
+           section->lines[hunk->first + hunk->count - 1 - *trail].type == ' ') (*trail)++;
+}
+
+// 在目标文件中定位补丁块：按行索引直接跳到预计位置，再向两边逐行偏移查找，
+// 找不到时逐步忽略首尾上下文（模糊匹配）
+// 成功时返回 1，*pos 为第 *skip_lead 个旧行对应的目标行
+static int locate_hunk(const FileInfo *file, const PatchSection *section, const PatchHunk *hunk,
+                       int cursor, int offset, int max_fuzz,
+                       int *pos, int *skip_lead, int *skip_trail, int *fuzz) {
+    int lead, trail;
+    hunk_context(section, hunk, &lead, &trail);
+    int start = (hunk->old_count > 0 ? hunk->old_start - 1 : hunk->old_start) + offset;
+    
+    for (int f = 0; f <= max_fuzz; f++) {
+        int drop_lead = f < lead ? f : lead;
+        int drop_trail = f < trail ? f : trail;
+        if (f > 0 && drop_lead == 0 && drop_trail == 0) break;
+        int need = hunk->old_count - drop_lead - drop_trail;
+        int expected = start + drop_lead;
+        int last = file->line_count - need;
+        
+        for (int d = 0; expected - d >= cursor || expected + d <= last; d++) {
+            for (int sign = 0; sign < 2; sign++) {
+                int candidate = sign == 0 ? expected + d : expected - d;
+                if (sign == 1 && d == 0) continue;
+                if (candidate < cursor || candidate > last) continue;
+                if (hunk_matches(file, candidate, section, hunk, drop_lead, need)) {
+                    *pos = candidate;
+                    *skip_lead = drop_lead;
+                    *skip_trail = drop_trail;
+                    *fuzz = f;
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// 输出一行；上一行缺少换行符而后面还有内容时先补上
+static void write_line(FILE *out, const char *text, int len, int newline, int *unterminated) {
+    if (*unterminated) fputc('\n', out);
+    fwrite(text, 1, len, out);
+    if (newline) fputc('\n', out);
+    *unterminated = !newline;
+}
+
+static void write_file_lines(FILE *out, const FileInfo *file, int from, int to, int *unterminated) {
+    for (int i = from; i < to; i++) {
+        write_line(out, line_text(file, i), line_length(file, i), has_newline(file, i), unterminated);
+    }
+}
+
+// name 所在的目录是否存在
+static int parent_exists(const char *name) {
+    const char *slash = strrchr(name, '/');
+    if (slash == NULL) return 1;
+    if (slash == name) return 1;
+    char *parent = strndup(name, slash - name);
+    struct stat st;
+    int exists = parent && stat(parent, &st) == 0 && S_ISDIR(st.st_mode);
+    free(parent);
+    return exists;
+}
+
+// 唯一的块从空文件开始（"-0,0"）
+static int from_empty_file(const PatchSection *section) {
+    return section->hunk_count == 1 &&
+           section->hunks[0].old_start == 0 && section->hunks[0].old_count == 0;
+}
+
+// 按补丁中的文件名查找目标：优先用旧文件名，找不到时去掉 a/、b/ 这样的第一级目录再试；
+// 新建文件时选所在目录存在的名字
+static char* find_patch_target(const PatchSection *section, int create) {
+    const char *names[2] = {section->old_name, section->new_name};
+    
+    for (int strip = 0; strip < 2; strip++) {
+        for (int k = create ? 1 : 0; k < 2; k++) {
+            const char *name = names[k];
+            if (strcmp(name, "/dev/null") == 0) continue;
+            if (strip) {
+                const char *slash = strchr(name, '/');
+                if (slash == NULL) continue;
+                name = slash + 1;
+            }
+            if (create ? parent_exists(name) : file_exists(name)) return strdup(name);
+        }
+    }
+    return NULL;
+}
+
+// 确定补丁段要修改的文件；*create 传入时为补丁本身标明的新建（旧文件为 /dev/null
+// 或 diff -N 的 1970-01-01 时间戳），旧文件不存在且只有一个从空文件开始的块时也按新建处理
+static char* patch_target(const PatchSection *section, int *create) {
+    char *target = find_patch_target(section, *create);
+    if (target == NULL && !*create && from_empty_file(section)) {
+        *create = 1;
+        target = find_patch_target(section, 1);
+    }
+    return target;
+}
+
+// 一个目标文件的修补结果：所有文件段都成功后才用临时文件替换目标文件
+typedef struct {
+    char *target;
+    char *temp_path;    // 已写好的结果，同一文件的后续段在它的基础上继续修补
+    mode_t mode;
+    int remove;         // 补丁把文件改为 /dev/null
+} PatchOutput;
+
+// 把一个文件段的所有块应用到 output，结果写到新的临时文件；返回 0 成功
+static int apply_section(PatchOutput *output, int create, const PatchSection *section, Options *opts) {
+    const char *target = output->target;
+    const char *source = output->temp_path ? output->temp_path : target;
+    FileInfo file;
+    struct stat st;
+    
+    if (create && !file_exists(source)) {
+        memset(&file, 0, sizeof(file));
+        file.filename = strdup(target);
+    } else if (!read_file(source, &file)) {
+        print_error("无法读取文件: %s", target);
+        free_file_info(&file);
+        return 1;
+    } else if (output->temp_path == NULL && stat(target, &st) == 0) {
+        output->mode = st.st_mode & 07777;
+    }
+    
+    // 新建文件的补丁不能覆盖已有内容
+    if (create && file.line_count > 0) {
+        print_error("文件已存在: %s", target);
+        free_file_info(&file);
+        return 1;
+    }
+    
+    size_t path_len = strlen(target) + 16;
+    char *temp_path = malloc(path_len);
+    snprintf(temp_path, path_len, "%s.tkdiff-XXXXXX", target);
+    int fd = mkstemp(temp_path);
+    FILE *out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (out == NULL) {
+        print_error("无法创建临时文件: %s", temp_path);
+        if (fd >= 0) close(fd);
+        free(temp_path);
+        free_file_info(&file);
+        return 1;
+    }
+    
+    printf("正在修补文件 %s\n", target);
+    
+    int cursor = 0;         // 目标文件中已输出到的行
+    int offset = 0;         // 之前的块实际位置与块头行号之差
+    int unterminated = 0;
+    int failed = 0;
+    
+    for (int h = 0; h < section->hunk_count; h++) {
+        const PatchHunk *hunk = &section->hunks[h];
+        int pos, skip_lead, skip_trail, fuzz;
+        if (!locate_hunk(&file, section, hunk, cursor, offset, opts->fuzz,
+                         &pos, &skip_lead, &skip_trail, &fuzz)) {
+            print_error("第 %d 个块应用失败（原文件第 %d 行）", h + 1, hunk->old_start);
+            failed = 1;
+            break;
+        }
+        
+        int expected = (hunk->old_count > 0 ? hunk->old_start - 1 : hunk->old_start) + skip_lead;
+        offset = pos - expected;
+        if (offset != 0 || fuzz > 0) {
+            printf("第 %d 个块在第 %d 行应用成功（偏移 %d 行，模糊 %d）\n",
+                   h + 1, pos - skip_lead + 1, offset, fuzz);
+        }
+        
+        // 块前的行原样输出，块内上下文取目标文件中的行，插入行取补丁中的行
+        write_file_lines(out, &file, cursor, pos, &unterminated);
+        int seen = 0;
+        int end = hunk->count;
+        for (int t = 0; t < skip_trail; t++) end--;
+        for (int k = 0; k < end; k++) {
+            const PatchLine *line = &section->lines[hunk->first + k];
+            if (line->type != '+' && seen++ < skip_lead) continue;
+            if (line->type == ' ') {
+                write_file_lines(out, &file, pos, pos + 1, &unterminated);
+                pos++;
+            } else if (line->type == '-') {
+                pos++;
+            } else {
+                write_line(out, line->text, line->length, !line->no_newline, &unterminated);
+            }
+        }
+        cursor = pos;
+    }
+    
+    if (!failed) write_file_lines(out, &file, cursor, file.line_count, &unterminated);
+    failed |= fflush(out) != 0;
+    int empty = ftell(out) == 0;
+    fclose(out);
+    
+    if (failed) {
+        unlink(temp_path);
+        free(temp_path);
+    } else {
+        if (output->temp_path) {
+            unlink(output->temp_path);
+            free(output->temp_path);
+        }
+        output->temp_path = temp_path;
+        // 新文件名为 /dev/null，或者（diff -N 的输出）新文件时间戳为 1970-01-01
+        // 且唯一的块把文件改为空文件时删除文件
+        output->remove = strcmp(section->new_name, "/dev/null") == 0 ||
+                         (empty && section->new_epoch && section->hunk_count == 1 &&
+                          section->hunks[0].new_start == 0 && section->hunks[0].new_count == 0);
+    }
+    
+    free_file_info(&file);
+    return failed;
+}
+
+// 用临时文件替换目标文件，或删除目标文件；返回 0 成功
+static int commit_output(const PatchOutput *output) {
+    if (output->remove) {
+        unlink(output->temp_path);
+        if (unlink(output->target) != 0) {
+            print_error("无法删除文件: %s", output->target);
+            return 1;
+        }
+        return 0;
+    }
+    chmod(output->temp_path, output->mode);
+    if (rename(output->temp_path, output->target) != 0) {
+        print_error("无法替换文件: %s", output->target);
+        unlink(output->temp_path);
+        return 1;
+    }
     return 0;
 }
 
+// 应用补丁文件中的所有文件段；指定了 target_path 时都应用到该文件。
+// 先把每个文件的结果都写到临时文件，全部成功后才替换，任何一段失败都不修改文件
+// 返回 0 全部成功，1 有失败
+static int apply_patch(const char *patch_path, const char *target_path, Options *opts) {
+    FileInfo patch;
+    if (!read_file(patch_path, &patch)) {
+        print_error("无法读取补丁文件: %s", patch_path);
+        free_file_info(&patch);
+        return 1;
+    }
+    
+    int failed = 0;
+    int sections = 0;
+    int i = 0;
+    PatchOutput *outputs = NULL;
+    int output_count = 0, output_capacity = 0;
+    
+    while (i < patch.line_count) {
+        if (!(line_starts_with(&patch, i, "--- ") && i + 1 < patch.line_count &&
+              line_starts_with(&patch, i + 1, "+++ "))) {
+            i++;
+            continue;
+        }
+        
+        PatchSection section;
+        memset(&section, 0, sizeof(section));
+        if (!parse_patch_section(&patch, &i, &section)) {
+            free_patch_section(&section);
+            failed = 1;
+            break;
+        }
+        sections++;
+        
+        int create = strcmp(section.old_name, "/dev/null") == 0 ||
+                     (section.old_epoch && from_empty_file(&section));
+        char *target = target_path ? strdup(target_path) : patch_target(&section, &create);
+        PatchOutput *output = NULL;
+        if (target == NULL) {
+            print_error("找不到要修补的文件: %s", section.old_name);
+            failed = 1;
+        } else {
+            // 同一文件出现在多个段中时接着上一段的结果修补
+            for (int k = 0; k < output_count && output == NULL; k++) {
+                if (strcmp(outputs[k].target, target) == 0) output = &outputs[k];
+            }
+            if (output == NULL && output_count == output_capacity) {
+                int capacity = output_capacity ? output_capacity * 2 : 8;
+                PatchOutput *grown = realloc(outputs, capacity * sizeof(PatchOutput));
+                if (grown) {
+                    outputs = grown;
+                    output_capacity = capacity;
+                }
+            }
+            if (output == NULL && output_count == output_capacity) {
+                print_error("内存分配失败");
+                failed = 1;
+            } else if (output == NULL) {
+                output = &outputs[output_count++];
+                output->target = target;
+                output->temp_path = NULL;
+                output->mode = 0644;
+                output->remove = 0;
+                target = NULL;
+            }
+            if (output) failed |= apply_section(output, create, &section, opts);
+        }
+        
+        free(target);
+        free_patch_section(&section);
+    }
+    
+    if (sections == 0 && !failed) {
+        print_error("%s 中没有统一差异格式的补丁", patch_path);
+        failed = 1;
+    }
+    
+    if (failed && output_count > 0) {
+        print_error("补丁未应用，没有修改任何文件");
+    }
+    for (int k = 0; k < output_count; k++) {
+        if (outputs[k].temp_path) {
+            if (failed) {
+                unlink(outputs[k].temp_path);
+            } else if (commit_output(&outputs[k]) != 0) {
+                failed = 1;
+            }
+        }
+        free(outputs[k].target);
+        free(outputs[k].temp_path);
+    }
+    free(outputs);
+    
+    free_file_info(&patch);
+    return failed;
+}
+
+// ========== 目录比较 ==========
+
+// 目录中的一项
+typedef struct {
+    char *name;
+    mode_t mode;
+    off_t size;
+    dev_t dev;
+    ino_t ino;
+} DirItem;
+
+// 两个目录树中同一相对路径的比较项
+typedef enum {
+    PAIR_ONLY1,         // 只在目录1中
+    PAIR_ONLY2,         // 只在目录2中
+    PAIR_FILES,         // 两边都是文件
+    PAIR_SUBDIRS,       // 两边都是目录（未指定 -r 时只报告）
+    PAIR_TYPE_MISMATCH  // 一边是目录，一边是文件
+} PairKind;
+
+typedef struct {
+    PairKind kind;
+    char *path1;
+    char *path2;
+    DirItem item1;      // 只对存在的一侧有效
+    DirItem item2;
+    Options *opts;
+    
+    // 以下由工作线程填写
+    int identical;
+    int binary;
+    off_t first_diff;
+    int error;
+    FileInfo file1;
+    FileInfo file2;
+    DiffChunk *diff;
+    int submitted;
+    int done;
+} FilePair;
+
+typedef struct {
+    FilePair *pairs;
+    int count;
+    int capacity;
+} PairList;
+
+static pthread_mutex_t pair_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pair_done = PTHREAD_COND_INITIALIZER;
+
+static int compare_item_name(const void *a, const void *b) {
+    return strcmp(((const DirItem *)a)->name, ((const DirItem *)b)->name);
+}
+
+// 读取并排序目录项（跟随符号链接取类型和大小）
+static int read_dir_items(const char *path, DirItem **items, int *count) {
+    *items = NULL;
+    *count = 0;
+    
+    DIR *dir = opendir(path);
+    if (dir == NULL) return 0;
+    
+    int capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        
+        if (*count >= capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            DirItem *grown = realloc(*items, sizeof(DirItem) * capacity);
+            if (grown == NULL) break;
+            *items = grown;
+        }
+        
+        DirItem *item = &(*items)[*count];
+        memset(item, 0, sizeof(*item));
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, 0) == 0) {
+            item->mode = st.st_mode;
+            item->size = st.st_size;
+            item->dev = st.st_dev;
+            item->ino = st.st_ino;
+        } else {
+            item->mode = S_IFREG;  // 失效链接等按文件处理，读取时再报错
+        }
+        item->name = strdup(entry->d_name);
+        (*count)++;
+    }
+    closedir(dir);
+    
+    qsort(*items, *count, sizeof(DirItem), compare_item_name);
+    return 1;
+}
+
+static void free_dir_items(DirItem *items, int count) {
+    for (int i = 0; i < count; i++) free(items[i].name);
+    free(items);
+}
+
+static char* join_path(const char *dir, const char *name) {
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+    if (path) sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+static FilePair* add_pair(PairList *list, PairKind kind, Options *opts) {
+    if (list->count >= list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 256;
+        FilePair *grown = realloc(list->pairs, sizeof(FilePair) * capacity);
+        if (grown == NULL) return NULL;
+        list->pairs = grown;
+        list->capacity = capacity;
+    }
+    
+    FilePair *pair = &list->pairs[list->count++];
+    memset(pair, 0, sizeof(*pair));
+    pair->kind = kind;
+    pair->opts = opts;
+    return pair;
+}
+
+// 归并两个已排序的目录，按路径顺序生成比较项；-r 时遇到公共子目录就地递归
+static void collect_pairs(PairList *list, const char *dir1, const char *dir2, Options *opts) {
+    DirItem *items1, *items2;
+    int count1, count2;
+    if (!read_dir_items(dir1, &items1, &count1)) {
+        print_error("无法打开目录: %s", dir1);
+        return;
+    }
+    if (!read_dir_items(dir2, &items2, &count2)) {
+        print_error("无法打开目录: %s", dir2);
+        free_dir_items(items1, count1);
+        return;
+    }
+    
+    int i = 0, j = 0;
+    while (i < count1 || j < count2) {
+        int cmp = i >= count1 ? 1 : j >= count2 ? -1 : strcmp(items1[i].name, items2[j].name);
+        
+        if (cmp < 0) {
+            FilePair *pair = add_pair(list, PAIR_ONLY1, opts);
+            if (pair) {
+                pair->path1 = join_path(dir1, items1[i].name);
+                pair->item1 = items1[i];
+                pair->item1.name = NULL;
+            }
+            i++;
+            continue;
+        }
+        if (cmp > 0) {
+            FilePair *pair = add_pair(list, PAIR_ONLY2, opts);
+            if (pair) {
+                pair->path2 = join_path(dir2, items2[j].name);
+                pair->item2 = items2[j];
+                pair->item2.name = NULL;
+            }
+            j++;
+            continue;
+        }
+        
+        int is_dir1 = S_ISDIR(items1[i].mode);
+        int is_dir2 = S_ISDIR(items2[j].mode);
+        char *path1 = join_path(dir1, items1[i].name);
+        char *path2 = join_path(dir2, items2[j].name);
+        
+        if (is_dir1 && is_dir2 && opts->recursive) {
+            if (path1 && path2) collect_pairs(list, path1, path2, opts);
+            free(path1);
+            free(path2);
+        } else {
+            PairKind kind = is_dir1 && is_dir2 ? PAIR_SUBDIRS :
+                            is_dir1 || is_dir2 ? PAIR_TYPE_MISMATCH : PAIR_FILES;
+            FilePair *pair = add_pair(list, kind, opts);
+            if (pair) {
+                pair->path1 = path1;
+                pair->path2 = path2;
+                pair->item1 = items1[i];
+                pair->item2 = items2[j];
+                pair->item1.name = pair->item2.name = NULL;  // 名称已在路径中
+            } else {
+                free(path1);
+                free(path2);
+            }
+        }
+        i++;
+        j++;
+    }
+    
+    free_dir_items(items1, count1);
+    free_dir_items(items2, count2);
+}
+
+// 两个文件内容是否完全相同：同一 inode 直接相同，否则比较内容
+static int files_identical(FilePair *pair) {
+    if (pair->item1.dev == pair->item2.dev && pair->item1.ino == pair->item2.ino &&
+        pair->item1.ino != 0) {
+        return 1;
+    }
+    return compare_contents(pair->path1, pair->path2, pair->item1.size, pair->item2.size,
+                            0, &pair->first_diff) == 1;
+}
+
+// 工作线程：先快速判断是否相同，不同时才读入并计算差异
+// -i/-w 时字节不同的文件也可能等价，-q 也要按行比较
+static void compare_pair(void *arg) {
+    FilePair *pair = arg;
+    Options *opts = pair->opts;
+    int normalize = opts->ignore_case || opts->ignore_whitespace;
+    
+    pair->identical = files_identical(pair);
+    if (!pair->identical && (!opts->brief || normalize)) {
+        pair->binary = is_binary_file(pair->path1) || is_binary_file(pair->path2);
+    }
+    if (!pair->identical && (!opts->brief || normalize) && !pair->binary) {
+        pair->error = diff_files(pair->path1, pair->path2, opts,
+                                 &pair->file1, &pair->file2, &pair->diff);
+        if (pair->error == 0 && diff_is_empty(pair->diff)) pair->identical = 1;
+    }
+    
+    pthread_mutex_lock(&pair_lock);
+    pair->done = 1;
+    pthread_cond_broadcast(&pair_done);
+    pthread_mutex_unlock(&pair_lock);
+}
+
+static void submit_pair(WorkPool *pool, FilePair *pair) {
+    if (pair->kind != PAIR_FILES || pair->submitted) return;
+    pair->submitted = 1;
+    if (pool == NULL || !workpool_submit(pool, compare_pair, pair)) {
+        compare_pair(pair);
+    }
+}
+
+static void wait_pair(FilePair *pair) {
+    pthread_mutex_lock(&pair_lock);
+    while (!pair->done) {
+        pthread_cond_wait(&pair_done, &pair_lock);
+    }
+    pthread_mutex_unlock(&pair_lock);
+}
+
+// 输出"只在某目录中"
+static void show_only_in(const char *path, Options *opts) {
+    const char *slash = strrchr(path, '/');
+    int dir_len = slash ? (int)(slash - path) : 0;
+    const char *name = slash ? slash + 1 : path;
+    
+    if (opts->color_output) {
+        color_println(COLOR_BRIGHT_YELLOW, "只在 %.*s 中: %s", dir_len, path, name);
+    } else {
+        printf("只在 %.*s 中: %s\n", dir_len, path, name);
+    }
+}
+
+// 按路径顺序输出一个比较项
+static void show_pair(FilePair *pair, Options *opts) {
+    switch (pair->kind) {
+    case PAIR_ONLY1:
+        show_only_in(pair->path1, opts);
+        break;
+    case PAIR_ONLY2:
+        show_only_in(pair->path2, opts);
+        break;
+    case PAIR_SUBDIRS:
+        printf("公共子目录: %s 和 %s\n", pair->path1, pair->path2);
+        break;
+    case PAIR_TYPE_MISMATCH:
+        printf("%s 是%s，而 %s 是%s\n",
+               pair->path1, S_ISDIR(pair->item1.mode) ? "目录" : "文件",
+               pair->path2, S_ISDIR(pair->item2.mode) ? "目录" : "文件");
+        break;
+    case PAIR_FILES:
+        if (pair->identical) break;
+        if (opts->brief) {
+            show_brief(pair->path1, pair->path2, 0, opts);
+            break;
+        }
+        if (pair->binary) {
+            show_binary_result(pair->path1, pair->path2, 0, pair->first_diff, opts);
+            break;
+        }
+        if (pair->error) {
+            report_diff_error(pair->error, pair->path1, pair->path2);
+            break;
+        }
+        if (opts->color_output) {
+            color_println(COLOR_BRIGHT_CYAN, "diff %s %s", pair->path1, pair->path2);
+        } else {
+            printf("diff %s %s\n", pair->path1, pair->path2);
+        }
+        show_result(&pair->file1, &pair->file2, pair->diff, opts);
+        break;
+    }
+}
+
 // 比较两个目录
 static int compare_directories(const char *dir1_path, const char *dir2_path, Options *opts) {
-    // 简化版：只报告目录是否相同
     struct stat st1, st2;
     
     if (stat(dir1_path, &st1) == -1) {
@@ -735,8 +3038,45 @@ static int compare_directories(const char *dir1_path, const char *dir2_path, Opt
         printf("比较目录: %s 和 %s\n", dir1_path, dir2_path);
     }
     
-    // 这里可以添加递归比较目录内容的代码
-    printf("（目录比较功能待完善）\n");
+    PairList list = {NULL, 0, 0};
+    collect_pairs(&list, dir1_path, dir2_path, opts);
+    
+    // 文件比较交给线程池，主线程按路径顺序取结果输出，最多提前 DIR_DIFF_AHEAD 项
+    WorkPool *pool = workpool_create(0, 0);
+    int differences = 0;
+    
+    for (int k = 0; k < list.count && k < DIR_DIFF_AHEAD; k++) {
+        submit_pair(pool, &list.pairs[k]);
+    }
+    
+    for (int k = 0; k < list.count; k++) {
+        if (k + DIR_DIFF_AHEAD < list.count) {
+            submit_pair(pool, &list.pairs[k + DIR_DIFF_AHEAD]);
+        }
+        
+        FilePair *pair = &list.pairs[k];
+        if (pair->kind == PAIR_FILES) wait_pair(pair);
+        if (pair->kind != PAIR_FILES || !pair->identical) differences++;
+        show_pair(pair, opts);
+        fflush(stdout);
+        
+        free_diff_chunks(pair->diff);
+        free_file_info(&pair->file1);
+        free_file_info(&pair->file2);
+        free(pair->path1);
+        free(pair->path2);
+    }
+    
+    workpool_destroy(pool);
+    free(list.pairs);
+    
+    if (differences == 0) {
+        if (opts->color_output) {
+            color_println(COLOR_BRIGHT_GREEN, "目录内容相同");
+        } else {
+            printf("目录内容相同\n");
+        }
+    }
     
     return 0;
 }
@@ -748,8 +3088,9 @@ int tkdiff_main(int argc, char **argv) {
     
     char *file1 = NULL;
     char *file2 = NULL;
+    char *file3 = NULL;
     
-    int parse_result = parse_options(argc, argv, &opts, &file1, &file2);
+    int parse_result = parse_options(argc, argv, &opts, &file1, &file2, &file3);
     if (parse_result <= 0) {
         return parse_result == -1 ? 1 : 0;
     }
@@ -764,6 +3105,10 @@ int tkdiff_main(int argc, char **argv) {
         return 0;
     }
     
+    if (opts.apply) {
+        return apply_patch(file1, file2, &opts);
+    }
+    
     // 检查文件是否存在
     if (!file_exists(file1)) {
         print_error("文件不存在: %s", file1);
@@ -775,6 +3120,14 @@ int tkdiff_main(int argc, char **argv) {
         return 1;
     }
     
+    if (opts.merge) {
+        if (!file_exists(file3)) {
+            print_error("文件不存在: %s", file3);
+            return 1;
+        }
+        return merge_files(file1, file2, file3, &opts);
+    }
+    
     // 判断是文件比较还是目录比较
     struct stat st1, st2;
     stat(file1, &st1);
@@ -785,10 +3138,13 @@ int tkdiff_main(int argc, char **argv) {
         return compare_directories(file1, file2, &opts);
     } else if (!S_ISDIR(st1.st_mode) && !S_ISDIR(st2.st_mode)) {
         // 文件比较
+        if (opts.sorted) {
+            return compare_sorted(file1, file2, &opts);
+        }
         return compare_files(file1, file2, &opts);
     } else {
         // 类型不同
         print_error("不能比较文件和目录");
         return 1;
     }
-}
\ No newline at end of file
+}
\ No newline at end of file
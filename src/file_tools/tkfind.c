@@ -11,8 +11,23 @@
 #include <regex.h>
 #include <errno.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <spawn.h>
 #include "../common/colors.h"
 #include "../common/utils.h"
+#include "../common/workpool.h"
+#include "../common/hash.h"
+
+#define BINARY_PROBE_SIZE 8192      // 二进制检测读取的字节数
+#define READ_CHUNK_SIZE (1 << 20)   // 无法 mmap 时的读取块大小
+#define MMAP_MIN_SIZE (64 * 1024)   // 小文件直接 read，省去映射开销
+#define EXEC_ARG_HEADROOM 4096      // 为 -exec + 预留的参数空间余量
+#define DUPE_EDGE_SIZE 4096         // --dupes 预筛时读取的首尾字节数
+
+extern char **environ;
 
 // 搜索选项
 typedef struct {
@@ -28,6 +43,19 @@ typedef struct {
     int color_output;       // 彩色输出
     int show_stats;         // 显示统计信息
     int show_details;       // 显示详细信息
+    int sort_results;       // 按路径排序输出（需缓存结果）
+    int max_depth;          // 最大搜索深度（-1 不限制）
+    int count_matches;      // 统计每个文件的匹配行数
+    int jobs;               // 内容搜索线程数
+    char **exec_argv;       // -exec 命令（不含结尾的 ; 或 +）
+    int exec_argc;          // -exec 命令参数个数
+    int exec_batch;         // -exec ... {} + 批量模式
+    int exec_jobs;          // -P 并行子进程数
+    int find_dupes;         // --dupes 查找重复文件
+    int disk_usage;         // --du 统计目录占用
+    int du_top;             // --du 显示的目录数
+    regex_t name_regex;     // 预编译的文件名正则
+    int name_compiled;      // name_regex 是否可用
     int help;               // 帮助
     int version;            // 版本
     char **paths;           // 搜索路径
@@ -55,6 +83,18 @@ static void init_options(Options *opts) {
     opts->color_output = is_color_supported();
     opts->show_stats = 0;
     opts->show_details = 0;
+    opts->sort_results = 0;
+    opts->max_depth = -1;
+    opts->count_matches = 0;
+    opts->jobs = 0;
+    opts->exec_argv = NULL;
+    opts->exec_argc = 0;
+    opts->exec_batch = 0;
+    opts->exec_jobs = 1;
+    opts->find_dupes = 0;
+    opts->disk_usage = 0;
+    opts->du_top = 20;
+    opts->name_compiled = 0;
     opts->help = 0;
     opts->version = 0;
     opts->paths = NULL;
@@ -76,13 +116,22 @@ static void show_help() {
     printf("                     +100k: 大于100KB, -1M: 小于1MB\n");
     printf("  -mtime DAYS        按修改时间过滤\n");
     printf("                     +7: 超过7天, -1: 1天内\n");
-    printf("  -content PATTERN   搜索文件内容\n");
+    printf("  -content PATTERN   搜索文件内容（找到第一处匹配即停止）\n");
+    printf("  -count             统计每个文件的匹配行数\n");
+    printf("  -j N               内容搜索线程数（默认CPU核数）\n");
     printf("  -i, --ignore-case  忽略大小写（内容搜索）\n");
     printf("  -r, --recursive    递归搜索子目录（默认）\n");
     printf("  -maxdepth LEVEL    最大搜索深度\n");
     printf("  -print             打印完整路径\n");
     printf("  -ls                类似ls -l的格式显示\n");
     printf("  -stat              显示统计信息\n");
+    printf("  -sort              按路径排序后输出（默认边找边输出）\n");
+    printf("  -exec CMD {} ;     对每个结果执行命令\n");
+    printf("  -exec CMD {} +     把尽可能多的结果合并到一次命令调用\n");
+    printf("  -P N               -exec 最多同时运行 N 个子进程\n");
+    printf("      --dupes        查找内容相同的重复文件\n");
+    printf("      --du           统计各目录的占用空间（并行遍历）\n");
+    printf("  -top N             --du 显示占用最大的 N 个目录（默认20）\n");
     printf("      --no-color     无颜色输出\n");
     printf("      --help         显示帮助\n");
     printf("      --version      显示版本\n");
@@ -128,8 +177,6 @@ static int parse_size_filter(const char *filter, long long *size) {
 
 // 解析选项
 static int parse_options(int argc, char **argv, Options *opts) {
-    int max_depth = -1;
-    
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-name") == 0) {
             if (i + 1 < argc) {
@@ -163,17 +210,50 @@ static int parse_options(int argc, char **argv, Options *opts) {
             if (i + 1 < argc) {
                 opts->time_filter = argv[++i];
             }
-        } else if (strcmp(argv[i], "-content") == 0) {
+        } else if (strcmp(argv[i], "-content") == 0 || strcmp(argv[i], "--content") == 0) {
             if (i + 1 < argc) {
                 opts->content_pattern = argv[++i];
             }
+        } else if (strcmp(argv[i], "-exec") == 0) {
+            int start = ++i;
+            while (i < argc && strcmp(argv[i], ";") != 0 &&
+                   !(strcmp(argv[i], "+") == 0 && i > start &&
+                     strcmp(argv[i - 1], "{}") == 0)) {
+                i++;
+            }
+            if (i >= argc || i == start) {
+                print_error("-exec 缺少结尾的 ';' 或 '+'");
+                return -1;
+            }
+            opts->exec_argv = &argv[start];
+            opts->exec_argc = i - start;
+            opts->exec_batch = argv[i][0] == '+';
+        } else if (strcmp(argv[i], "-P") == 0) {
+            if (i + 1 < argc) {
+                opts->exec_jobs = atoi(argv[++i]);
+                if (opts->exec_jobs < 1) opts->exec_jobs = 1;
+            }
+        } else if (strcmp(argv[i], "--dupes") == 0) {
+            opts->find_dupes = 1;
+        } else if (strcmp(argv[i], "--du") == 0) {
+            opts->disk_usage = 1;
+        } else if (strcmp(argv[i], "-top") == 0) {
+            if (i + 1 < argc) {
+                opts->du_top = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "-count") == 0) {
+            opts->count_matches = 1;
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 < argc) {
+                opts->jobs = atoi(argv[++i]);
+            }
         } else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--ignore-case") == 0) {
             opts->ignore_case = 1;
         } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--recursive") == 0) {
             opts->recursive = 1;
         } else if (strcmp(argv[i], "-maxdepth") == 0) {
             if (i + 1 < argc) {
-                max_depth = atoi(argv[++i]);
+                opts->max_depth = atoi(argv[++i]);
             }
         } else if (strcmp(argv[i], "-print") == 0) {
             opts->print_path = 1;
@@ -181,6 +261,8 @@ static int parse_options(int argc, char **argv, Options *opts) {
             opts->show_details = 1;
         } else if (strcmp(argv[i], "-stat") == 0) {
             opts->show_stats = 1;
+        } else if (strcmp(argv[i], "-sort") == 0) {
+            opts->sort_results = 1;
         } else if (strcmp(argv[i], "--no-color") == 0) {
             opts->color_output = 0;
         } else if (strcmp(argv[i], "--help") == 0) {
@@ -210,30 +292,34 @@ static int parse_options(int argc, char **argv, Options *opts) {
     return 1;
 }
 
+// 预编译文件名正则，避免每个目录项重复 regcomp
+static int compile_name_pattern(Options *opts) {
+    if (!opts->name_pattern || !opts->regex_mode) return 1;
+    
+    int flags = REG_EXTENDED | REG_NOSUB;
+    if (opts->ignore_case) flags |= REG_ICASE;
+    
+    if (regcomp(&opts->name_regex, opts->name_pattern, flags) != 0) {
+        print_error("无效的正则表达式: %s", opts->name_pattern);
+        return 0;
+    }
+    opts->name_compiled = 1;
+    return 1;
+}
+
 // 检查文件名是否匹配模式
-static int match_name(const char *filename, const char *pattern, 
-                     int regex_mode, int ignore_case) {
-    if (!pattern) return 1;  // 没有模式，匹配所有
+static int match_name(const char *filename, Options *opts) {
+    if (!opts->name_pattern) return 1;  // 没有模式，匹配所有
     
-    if (regex_mode) {
-        regex_t regex;
-        int flags = REG_EXTENDED;
-        if (ignore_case) flags |= REG_ICASE;
-        
-        if (regcomp(&regex, pattern, flags) != 0) {
-            return 0;
-        }
-        
-        int result = regexec(&regex, filename, 0, NULL, 0);
-        regfree(&regex);
-        
-        return result == 0;
+    if (opts->regex_mode) {
+        return opts->name_compiled &&
+               regexec(&opts->name_regex, filename, 0, NULL, 0) == 0;
     } else {
         // 使用fnmatch进行通配符匹配
         int flags = 0;
-        if (ignore_case) flags |= FNM_CASEFOLD;
+        if (opts->ignore_case) flags |= FNM_CASEFOLD;
         
-        return fnmatch(pattern, filename, flags) == 0;
+        return fnmatch(opts->name_pattern, filename, flags) == 0;
     }
 }
 
@@ -322,130 +408,236 @@ static int match_time(const char *time_filter, time_t mtime) {
     }
 }
 
-// 在文件中搜索内容
-static int search_content(const char *path, const char *pattern, 
-                         int ignore_case, int *match_count) {
-    FILE *file = fopen(path, "r");
-    if (!file) return 0;
-    
-    char line[4096];
-    int line_num = 0;
-    *match_count = 0;
+// 内容匹配器：编译一次，所有搜索线程共享
+typedef struct {
+    regex_t *regexes;       // 每个线程一份（glibc 的 regexec 对同一 regex_t 加锁）
+    int regex_count;        // regexes 数量（slot 0 给非池内线程）
+    char *literal;          // 匹配行中必然出现的字面量，用于预筛
+    size_t literal_len;
+    int pure_literal;       // 模式本身就是字面量，预筛命中即匹配
+    int count_all;          // 需要完整计数，否则首个匹配即停止
+} ContentMatcher;
+
+// 从扩展正则中提取必然出现的最长字面量，无法确定时返回 NULL
+static char* extract_literal(const char *pattern, int ignore_case, int *pure_literal) {
+    size_t len = strlen(pattern);
+    *pure_literal = 0;
     
-    // 准备正则表达式
-    regex_t regex;
-    int flags = REG_EXTENDED;
-    if (ignore_case) flags |= REG_ICASE;
+    // 含分支时没有必然出现的字面量
+    if (len == 0 || strchr(pattern, '|')) return NULL;
     
-    if (regcomp(&regex, pattern, flags) != 0) {
-        fclose(file);
-        return 0;
+    char *run = malloc(len + 1);
+    char *best = malloc(len + 1);
+    if (!run || !best) {
+        free(run);
+        free(best);
+        return NULL;
     }
+    size_t run_len = 0, best_len = 0;
+    int depth = 0;
+    int has_meta = 0;
     
-    while (fgets(line, sizeof(line), file)) {
-        line_num++;
+    for (size_t i = 0; i <= len; i++) {
+        char c = pattern[i];
+        if (c && depth == 0 && !strchr(".[]()*+?{}|^$\\", c)) {
+            run[run_len++] = c;
+            continue;
+        }
         
-        // 去除换行符
-        line[strcspn(line, "\n")] = '\0';
+        if (c) has_meta = 1;
         
-        if (regexec(&regex, line, 0, NULL, 0) == 0) {
-            (*match_count)++;
+        // *, ?, {m,n} 使前一个字符可选
+        if ((c == '*' || c == '?' || c == '{') && run_len > 0) {
+            run_len--;
+        }
+        if (run_len > best_len) {
+            memcpy(best, run, run_len);
+            best_len = run_len;
         }
+        run_len = 0;
+        
+        if (c == '(') {
+            depth++;
+        } else if (c == ')' && depth > 0) {
+            depth--;
+        } else if (c == '[') {
+            // 跳过方括号表达式
+            i++;
+            if (pattern[i] == '^') i++;
+            if (pattern[i] == ']') i++;
+            while (pattern[i] && pattern[i] != ']') i++;
+        } else if (c == '{') {
+            while (pattern[i] && pattern[i] != '}') i++;
+        } else if (c == '\\' && pattern[i + 1]) {
+            i++;
+        }
+        if (!pattern[i]) break;
     }
+    free(run);
     
-    regfree(&regex);
-    fclose(file);
+    // 忽略大小写时只有不含字母的字面量才能直接比较字节
+    for (size_t i = 0; ignore_case && i < best_len; i++) {
+        if (isalpha((unsigned char)best[i])) {
+            best_len = 0;
+            break;
+        }
+    }
+    
+    if (best_len == 0) {
+        free(best);
+        return NULL;
+    }
     
+    best[best_len] = '\0';
+    *pure_literal = !has_meta && !ignore_case;
+    return best;
+}
+
+// 初始化内容匹配器
+static int content_matcher_init(ContentMatcher *m, const char *pattern,
+                                int ignore_case, int count_all, int threads) {
+    memset(m, 0, sizeof(*m));
+    m->count_all = count_all;
+    m->regex_count = threads + 1;
+    m->regexes = calloc(m->regex_count, sizeof(regex_t));
+    if (!m->regexes) return 0;
+    
+    int flags = REG_EXTENDED | REG_NOSUB | REG_NEWLINE;
+    if (ignore_case) flags |= REG_ICASE;
+    
+    for (int i = 0; i < m->regex_count; i++) {
+        if (regcomp(&m->regexes[i], pattern, flags) != 0) {
+            print_error("无效的正则表达式: %s", pattern);
+            m->regex_count = i;
+            return 0;
+        }
+    }
+    
+    m->literal = extract_literal(pattern, ignore_case, &m->pure_literal);
+    m->literal_len = m->literal ? strlen(m->literal) : 0;
     return 1;
 }
 
-// 获取文件颜色
-static const char* get_file_color(mode_t mode) {
-    if (S_ISDIR(mode)) return COLOR_BRIGHT_BLUE;
-    if (S_ISLNK(mode)) return COLOR_BRIGHT_CYAN;
-    if (mode & S_IXUSR) return COLOR_BRIGHT_GREEN;
-    return COLOR_WHITE;
+static void content_matcher_free(ContentMatcher *m) {
+    for (int i = 0; i < m->regex_count; i++) {
+        regfree(&m->regexes[i]);
+    }
+    free(m->regexes);
+    free(m->literal);
 }
 
-// 递归搜索目录
-static void search_directory(const char *path, Options *opts, 
-                            int depth, int max_depth,
-                            SearchResult **results, int *result_count,
-                            int *file_count, int *dir_count) {
-    DIR *dir = opendir(path);
-    if (!dir) return;
-    
-    struct dirent *entry;
+// 整块读入小文件或无法 mmap 的文件（如部分伪文件系统）
+static char* read_fully(int fd, size_t size_hint, size_t *size) {
+    size_t capacity = size_hint > 0 ? size_hint + 1 : READ_CHUNK_SIZE;
+    size_t used = 0;
+    char *buffer = malloc(capacity);
+    if (!buffer) return NULL;
     
-    while ((entry = readdir(dir)) != NULL) {
-        // 跳过 . 和 ..
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-        
-        char full_path[4096];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-        
-        struct stat st;
-        if (lstat(full_path, &st) == -1) {
-            continue;
+    ssize_t n;
+    while ((n = read(fd, buffer + used, capacity - used)) > 0) {
+        used += n;
+        if (used == capacity) {
+            char *grown = realloc(buffer, capacity * 2);
+            if (!grown) {
+                free(buffer);
+                return NULL;
+            }
+            buffer = grown;
+            capacity *= 2;
         }
-        
-        // 检查文件名匹配
-        if (!match_name(entry->d_name, opts->name_pattern, 
-                       opts->regex_mode, opts->ignore_case)) {
-            goto check_recursive;
+    }
+    
+    *size = used;
+    return buffer;
+}
+
+// 在文件中搜索内容：先用 memmem 预筛字面量，再对候选行执行正则
+static int search_content(ContentMatcher *m, const char *path, int *match_count) {
+    *match_count = 0;
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return 0;
+    }
+    
+    size_t size = st.st_size;
+    char *data = NULL;
+    int mapped = 0;
+    if (size >= MMAP_MIN_SIZE) {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            mapped = 1;
+            madvise(data, size, MADV_SEQUENTIAL);
         }
-        
-        // 检查文件类型
-        if (!match_type(opts->type_filter, st.st_mode)) {
-            goto check_recursive;
+    }
+    if (!mapped) {
+        data = read_fully(fd, size, &size);
+        if (!data) {
+            close(fd);
+            return 0;
         }
-        
-        // 检查文件大小
-        if (!match_size(opts->size_filter, st.st_size)) {
-            goto check_recursive;
+    }
+    close(fd);
+    
+    // 跳过二进制文件
+    size_t probe = size < BINARY_PROBE_SIZE ? size : BINARY_PROBE_SIZE;
+    int binary = memchr(data, '\0', probe) != NULL;
+    
+    int slot = workpool_worker_index() + 1;
+    if (slot >= m->regex_count) slot = 0;
+    regex_t *regex = &m->regexes[slot];
+    
+    const char *p = data;
+    const char *end = data + size;
+    
+    while (!binary && p < end) {
+        if (m->literal) {
+            const char *hit = memmem(p, end - p, m->literal, m->literal_len);
+            if (!hit) break;
+            
+            // 回到候选行的行首
+            const char *nl = memrchr(p, '\n', hit - p);
+            p = nl ? nl + 1 : p;
         }
         
-        // 检查修改时间
-        if (!match_time(opts->time_filter, st.st_mtime)) {
-            goto check_recursive;
-        }
+        const char *line_end = memchr(p, '\n', end - p);
+        if (!line_end) line_end = end;
         
-        // 如果是文件，检查内容
-        if (S_ISREG(st.st_mode) && opts->content_pattern) {
-            int match_count = 0;
-            if (!search_content(full_path, opts->content_pattern, 
-                              opts->ignore_case, &match_count) || match_count == 0) {
-                goto check_recursive;
-            }
+        int matched = m->pure_literal && m->literal;
+        if (!matched) {
+            regmatch_t range;
+            range.rm_so = 0;
+            range.rm_eo = line_end - p;
+            matched = regexec(regex, p, 1, &range, REG_STARTEND) == 0;
         }
         
-        // 添加到结果
-        (*result_count)++;
-        *results = realloc(*results, sizeof(SearchResult) * (*result_count));
-        SearchResult *result = &(*results)[*result_count - 1];
-        
-        result->path = strdup(full_path);
-        result->info = st;
-        result->matches = 0;
-        
-        if (S_ISDIR(st.st_mode)) {
-            (*dir_count)++;
-        } else {
-            (*file_count)++;
+        if (matched) {
+            (*match_count)++;
+            if (!m->count_all) break;
         }
         
-    check_recursive:
-        // 递归搜索子目录
-        if (S_ISDIR(st.st_mode) && opts->recursive && 
-            (max_depth == -1 || depth < max_depth)) {
-            search_directory(full_path, opts, depth + 1, max_depth,
-                           results, result_count, file_count, dir_count);
-        }
+        p = line_end + 1;
     }
     
-    closedir(dir);
+    if (mapped) {
+        munmap(data, size);
+    } else {
+        free(data);
+    }
+    
+    return 1;
+}
+
+// 获取文件颜色
+static const char* get_file_color(mode_t mode) {
+    if (S_ISDIR(mode)) return COLOR_BRIGHT_BLUE;
+    if (S_ISLNK(mode)) return COLOR_BRIGHT_CYAN;
+    if (mode & S_IXUSR) return COLOR_BRIGHT_GREEN;
+    return COLOR_WHITE;
 }
 
 // 显示文件信息（类似ls -l）
@@ -504,58 +696,930 @@ static void show_file_details(const char *path, struct stat *st, Options *opts)
     printf("\n");
 }
 
-// 显示搜索结果
-static void show_results(SearchResult *results, int result_count, 
-                        Options *opts, int file_count, int dir_count) {
+// -exec 执行器
+typedef struct {
+    char **command;         // 命令模板
+    int command_count;      // 模板参数个数
+    int batch_mode;         // {} + 模式：多个路径合并到一次调用
+    int max_jobs;           // 最多同时运行的子进程数
+    int running;            // 正在运行的子进程数
+    int failed;             // 失败的调用次数
+    char **batch;           // 当前批次的路径
+    int batch_count;
+    int batch_capacity;
+    size_t batch_bytes;     // 当前批次占用的参数空间
+    size_t arg_limit;       // 单次调用可用的参数空间
+} ExecRunner;
+
+// 初始化执行器，按 ARG_MAX 扣除环境变量后计算批量上限
+static void exec_runner_init(ExecRunner *runner, Options *opts) {
+    memset(runner, 0, sizeof(*runner));
+    runner->command = opts->exec_argv;
+    runner->command_count = opts->exec_argc;
+    runner->batch_mode = opts->exec_batch;
+    runner->max_jobs = opts->exec_jobs;
+    
+    long arg_max = sysconf(_SC_ARG_MAX);
+    if (arg_max <= 0) arg_max = 128 * 1024;
+    
+    size_t used = EXEC_ARG_HEADROOM;
+    for (char **env = environ; env && *env; env++) {
+        used += strlen(*env) + 1 + sizeof(char*);
+    }
+    for (int i = 0; i < runner->command_count; i++) {
+        used += strlen(runner->command[i]) + 1 + sizeof(char*);
+    }
+    
+    runner->arg_limit = (size_t)arg_max > used ? (size_t)arg_max - used : 0;
+}
+
+// 回收子进程；block 为真时至少等待一个
+static void exec_reap(ExecRunner *runner, int block) {
+    while (runner->running > 0) {
+        int status;
+        pid_t pid = waitpid(-1, &status, block ? 0 : WNOHANG);
+        if (pid <= 0) {
+            if (pid < 0 && errno == EINTR) continue;
+            if (pid < 0) runner->running = 0;
+            return;
+        }
+        
+        runner->running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            runner->failed++;
+        }
+        block = 0;
+    }
+}
+
+// 启动一个子进程，达到 -P 上限时先等待空位
+static void exec_spawn(ExecRunner *runner, char **argv) {
+    exec_reap(runner, 0);
+    while (runner->running >= runner->max_jobs) {
+        exec_reap(runner, 1);
+    }
+    
+    // 子进程继承 stdout，先刷出已缓冲的输出
+    fflush(stdout);
+    
+    pid_t pid;
+    int err = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    if (err != 0) {
+        print_error("无法执行 %s: %s", argv[0], strerror(err));
+        runner->failed++;
+        return;
+    }
+    runner->running++;
+}
+
+// 把参数中的 {} 替换为路径
+static char* substitute_path(const char *arg, const char *path) {
+    size_t path_len = strlen(path);
+    size_t count = 0;
+    for (const char *p = strstr(arg, "{}"); p; p = strstr(p + 2, "{}")) {
+        count++;
+    }
+    
+    char *result = malloc(strlen(arg) + count * path_len + 1);
+    if (!result) return NULL;
+    
+    char *out = result;
+    const char *p = arg;
+    const char *hit;
+    while ((hit = strstr(p, "{}")) != NULL) {
+        memcpy(out, p, hit - p);
+        out += hit - p;
+        memcpy(out, path, path_len);
+        out += path_len;
+        p = hit + 2;
+    }
+    strcpy(out, p);
+    
+    return result;
+}
+
+// 执行当前批次：命令模板去掉结尾的 {}，后接全部路径
+static void exec_flush(ExecRunner *runner) {
+    if (runner->batch_count == 0) return;
+    
+    int fixed = runner->command_count - 1;
+    char **argv = malloc(sizeof(char*) * (fixed + runner->batch_count + 1));
+    if (argv) {
+        memcpy(argv, runner->command, sizeof(char*) * fixed);
+        memcpy(argv + fixed, runner->batch, sizeof(char*) * runner->batch_count);
+        argv[fixed + runner->batch_count] = NULL;
+        exec_spawn(runner, argv);
+        free(argv);
+    } else {
+        runner->failed++;
+    }
+    
+    for (int i = 0; i < runner->batch_count; i++) {
+        free(runner->batch[i]);
+    }
+    runner->batch_count = 0;
+    runner->batch_bytes = 0;
+}
+
+// 为一个结果执行命令（或加入当前批次）
+static void exec_add(ExecRunner *runner, const char *path) {
+    if (!runner->batch_mode) {
+        char **argv = calloc(runner->command_count + 1, sizeof(char*));
+        if (!argv) {
+            runner->failed++;
+            return;
+        }
+        for (int i = 0; i < runner->command_count; i++) {
+            argv[i] = substitute_path(runner->command[i], path);
+        }
+        exec_spawn(runner, argv);
+        for (int i = 0; i < runner->command_count; i++) {
+            free(argv[i]);
+        }
+        free(argv);
+        return;
+    }
+    
+    size_t cost = strlen(path) + 1 + sizeof(char*);
+    if (runner->batch_count > 0 && runner->batch_bytes + cost > runner->arg_limit) {
+        exec_flush(runner);
+    }
+    
+    if (runner->batch_count >= runner->batch_capacity) {
+        int new_capacity = runner->batch_capacity ? runner->batch_capacity * 2 : 256;
+        char **grown = realloc(runner->batch, sizeof(char*) * new_capacity);
+        if (!grown) {
+            runner->failed++;
+            return;
+        }
+        runner->batch = grown;
+        runner->batch_capacity = new_capacity;
+    }
+    
+    runner->batch[runner->batch_count++] = strdup(path);
+    runner->batch_bytes += cost;
+}
+
+// 执行剩余批次并等待所有子进程
+static void exec_finish(ExecRunner *runner) {
+    exec_flush(runner);
+    while (runner->running > 0) {
+        exec_reap(runner, 1);
+    }
+    free(runner->batch);
+    runner->batch = NULL;
+}
+
+// 结果输出器：默认边找边输出，仅在 -sort 时缓存结果
+typedef struct {
+    Options *opts;
+    ExecRunner *exec;       // -exec 时结果交给执行器而不是打印
+    pthread_mutex_t lock;   // 内容搜索线程并发提交
+    SearchResult *results;  // 排序缓存（仅 -sort）
+    int capacity;           // 缓存容量
+    int stored_count;       // 已缓存的结果数
+    int result_count;       // 结果总数
+    int file_count;         // 文件数
+    int dir_count;          // 目录数
+} ResultSink;
+
+// 输出单条结果
+static void print_result(ResultSink *sink, const char *path, struct stat *st, int matches) {
+    Options *opts = sink->opts;
+    
+    if (sink->exec) {
+        exec_add(sink->exec, path);
+    } else if (opts->show_details) {
+        show_file_details(path, st, opts);
+    } else if (opts->count_matches && S_ISREG(st->st_mode)) {
+        if (opts->color_output) {
+            printf("%s%s%s:%d\n", get_file_color(st->st_mode), path, COLOR_RESET, matches);
+        } else {
+            printf("%s:%d\n", path, matches);
+        }
+    } else if (opts->color_output) {
+        const char *color = get_file_color(st->st_mode);
+        printf("%s%s%s\n", color, path, COLOR_RESET);
+    } else {
+        printf("%s\n", path);
+    }
+}
+
+// 提交一条结果：流式模式直接输出，排序/查重模式按倍增策略缓存
+static void sink_emit(ResultSink *sink, const char *path, struct stat *st, int matches) {
+    pthread_mutex_lock(&sink->lock);
+    sink->result_count++;
+    if (S_ISDIR(st->st_mode)) {
+        sink->dir_count++;
+    } else {
+        sink->file_count++;
+    }
+    
+    // 查重只关心非空普通文件
+    if (sink->opts->find_dupes && (!S_ISREG(st->st_mode) || st->st_size == 0)) {
+        pthread_mutex_unlock(&sink->lock);
+        return;
+    }
+    
+    if (!sink->opts->sort_results && !sink->opts->find_dupes) {
+        print_result(sink, path, st, matches);
+        pthread_mutex_unlock(&sink->lock);
+        return;
+    }
+    
+    int index = sink->stored_count;
+    if (index >= sink->capacity) {
+        int new_capacity = sink->capacity ? sink->capacity * 2 : 256;
+        SearchResult *grown = realloc(sink->results, sizeof(SearchResult) * new_capacity);
+        if (!grown) {
+            print_error("内存不足，无法缓存排序结果");
+            pthread_mutex_unlock(&sink->lock);
+            return;
+        }
+        sink->results = grown;
+        sink->capacity = new_capacity;
+    }
+    
+    SearchResult *result = &sink->results[index];
+    result->path = strdup(path);
+    if (!result->path) {
+        print_error("内存不足，无法缓存排序结果");
+        pthread_mutex_unlock(&sink->lock);
+        return;
+    }
+    result->info = *st;
+    result->matches = matches;
+    sink->stored_count++;
+    pthread_mutex_unlock(&sink->lock);
+}
+
+static int compare_results(const void *a, const void *b) {
+    const SearchResult *ra = (const SearchResult *)a;
+    const SearchResult *rb = (const SearchResult *)b;
+    return strcmp(ra->path, rb->path);
+}
+
+// --dupes 候选文件
+typedef struct {
+    SearchResult *result;   // 遍历时收集的结果（含 stat 信息）
+    uint64_t partial;       // 首尾 DUPE_EDGE_SIZE 字节的哈希
+    uint64_t full;          // 全文哈希
+    int failed;             // 读取失败
+} DupeEntry;
+
+// 哈希文件首尾各 DUPE_EDGE_SIZE 字节
+static void dupe_hash_edges(void *arg) {
+    DupeEntry *entry = arg;
+    off_t size = entry->result->info.st_size;
+    char buffer[DUPE_EDGE_SIZE * 2];
+    
+    int fd = open(entry->result->path, O_RDONLY);
+    if (fd < 0) {
+        entry->failed = 1;
+        return;
+    }
+    
+    size_t head = size < DUPE_EDGE_SIZE ? (size_t)size : DUPE_EDGE_SIZE;
+    size_t tail = 0;
+    if (size > DUPE_EDGE_SIZE) {
+        tail = size - DUPE_EDGE_SIZE < DUPE_EDGE_SIZE ? (size_t)(size - DUPE_EDGE_SIZE)
+                                                      : DUPE_EDGE_SIZE;
+    }
+    
+    if (pread(fd, buffer, head, 0) != (ssize_t)head ||
+        (tail > 0 && pread(fd, buffer + head, tail, size - tail) != (ssize_t)tail)) {
+        entry->failed = 1;
+    } else {
+        entry->partial = hash64(buffer, head + tail, 0);
+    }
+    
+    close(fd);
+}
+
+// 哈希整个文件
+static void dupe_hash_full(void *arg) {
+    DupeEntry *entry = arg;
+    size_t size = entry->result->info.st_size;
+    
+    int fd = open(entry->result->path, O_RDONLY);
+    if (fd < 0) {
+        entry->failed = 1;
+        return;
+    }
+    
+    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+        madvise(data, size, MADV_SEQUENTIAL);
+        entry->full = hash64(data, size, 0);
+        munmap(data, size);
+    } else {
+        size_t got = 0;
+        data = read_fully(fd, size, &got);
+        if (data && got == size) {
+            entry->full = hash64(data, got, 0);
+        } else {
+            entry->failed = 1;
+        }
+        free(data);
+    }
+    
+    close(fd);
+}
+
+// 按大小降序，再按 (设备, inode) 排序，便于剔除硬链接
+static int compare_dupe_inode(const void *a, const void *b) {
+    const struct stat *sa = &((const DupeEntry *)a)->result->info;
+    const struct stat *sb = &((const DupeEntry *)b)->result->info;
+    if (sa->st_size != sb->st_size) return sa->st_size < sb->st_size ? 1 : -1;
+    if (sa->st_dev != sb->st_dev) return sa->st_dev < sb->st_dev ? -1 : 1;
+    if (sa->st_ino != sb->st_ino) return sa->st_ino < sb->st_ino ? -1 : 1;
+    return 0;
+}
+
+static int compare_dupe_hash(const void *a, const void *b) {
+    const DupeEntry *ea = a;
+    const DupeEntry *eb = b;
+    off_t size_a = ea->result->info.st_size;
+    off_t size_b = eb->result->info.st_size;
+    if (size_a != size_b) return size_a < size_b ? 1 : -1;
+    if (ea->partial != eb->partial) return ea->partial < eb->partial ? -1 : 1;
+    if (ea->full != eb->full) return ea->full < eb->full ? -1 : 1;
+    return strcmp(ea->result->path, eb->result->path);
+}
+
+// 两个候选在当前阶段是否仍可能相同
+static int dupe_same(const DupeEntry *a, const DupeEntry *b) {
+    return a->result->info.st_size == b->result->info.st_size &&
+           a->partial == b->partial && a->full == b->full;
+}
+
+// 只保留成员数不少于2的组，返回保留的数量
+static int dupe_keep_groups(DupeEntry *entries, int count) {
+    int kept = 0;
+    for (int i = 0; i < count; ) {
+        int j = i + 1;
+        while (j < count && dupe_same(&entries[i], &entries[j])) j++;
+        
+        int members = 0;
+        for (int k = i; k < j; k++) {
+            if (!entries[k].failed) members++;
+        }
+        if (members >= 2) {
+            for (int k = i; k < j; k++) {
+                if (!entries[k].failed) entries[kept++] = entries[k];
+            }
+        }
+        i = j;
+    }
+    return kept;
+}
+
+// 查找重复文件：按大小分桶 -> 首尾哈希 -> 全文哈希
+static void report_duplicates(ResultSink *sink) {
+    Options *opts = sink->opts;
+    int count = 0;
+    
+    DupeEntry *entries = calloc(sink->stored_count > 0 ? sink->stored_count : 1,
+                                sizeof(DupeEntry));
+    if (!entries) {
+        print_error("内存不足，无法查找重复文件");
+        return;
+    }
+    
+    // 结果缓存里只有非空普通文件（见 sink_emit）
+    for (int i = 0; i < sink->stored_count; i++) {
+        entries[count++].result = &sink->results[i];
+    }
+    
+    // 第一步：按大小分桶，同一 inode 的硬链接只保留一个
+    qsort(entries, count, sizeof(DupeEntry), compare_dupe_inode);
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (unique > 0 && compare_dupe_inode(&entries[unique - 1], &entries[i]) == 0) {
+            continue;
+        }
+        entries[unique++] = entries[i];
+    }
+    count = dupe_keep_groups(entries, unique);
+    
+    WorkPool *pool = count > 0 ? workpool_create(opts->jobs, 0) : NULL;
+    
+    // 第二步：同大小的候选只读首尾
+    for (int i = 0; i < count; i++) {
+        if (!pool || !workpool_submit(pool, dupe_hash_edges, &entries[i])) {
+            dupe_hash_edges(&entries[i]);
+        }
+    }
+    workpool_wait(pool);
+    qsort(entries, count, sizeof(DupeEntry), compare_dupe_hash);
+    count = dupe_keep_groups(entries, count);
+    
+    // 第三步：全文哈希剩余候选，首尾已覆盖全文的小文件无需再读
+    for (int i = 0; i < count; i++) {
+        if (entries[i].result->info.st_size <= DUPE_EDGE_SIZE * 2) continue;
+        if (!pool || !workpool_submit(pool, dupe_hash_full, &entries[i])) {
+            dupe_hash_full(&entries[i]);
+        }
+    }
+    workpool_wait(pool);
+    workpool_destroy(pool);
+    qsort(entries, count, sizeof(DupeEntry), compare_dupe_hash);
+    count = dupe_keep_groups(entries, count);
+    
+    // 输出重复组
+    int groups = 0;
+    long long wasted = 0;
+    for (int i = 0; i < count; ) {
+        int j = i + 1;
+        while (j < count && dupe_same(&entries[i], &entries[j])) j++;
+        
+        off_t size = entries[i].result->info.st_size;
+        groups++;
+        wasted += (long long)size * (j - i - 1);
+        
+        if (opts->color_output) {
+            color_print(COLOR_BRIGHT_CYAN, "重复组 %d", groups);
+            printf(" (%s, %d 个文件):\n", format_size(size), j - i);
+        } else {
+            printf("重复组 %d (%s, %d 个文件):\n", groups, format_size(size), j - i);
+        }
+        for (int k = i; k < j; k++) {
+            printf("  %s\n", entries[k].result->path);
+        }
+        printf("\n");
+        i = j;
+    }
+    
+    if (groups == 0) {
+        printf("未发现重复文件\n");
+    } else if (opts->color_output) {
+        printf("共 ");
+        color_print(COLOR_BRIGHT_GREEN, "%d", groups);
+        printf(" 组重复文件，可释放 ");
+        color_print(COLOR_BRIGHT_YELLOW, "%s", format_size(wasted));
+        printf("\n");
+    } else {
+        printf("共 %d 组重复文件，可释放 %s\n", groups, format_size(wasted));
+    }
+    
+    free(entries);
+}
+
+// 结束输出：排序模式下统一输出，随后显示统计信息
+static void sink_finish(ResultSink *sink) {
+    Options *opts = sink->opts;
+    
+    if (opts->find_dupes) {
+        report_duplicates(sink);
+    } else if (opts->sort_results && sink->stored_count > 0) {
+        qsort(sink->results, sink->stored_count, sizeof(SearchResult), compare_results);
+        for (int i = 0; i < sink->stored_count; i++) {
+            print_result(sink, sink->results[i].path, &sink->results[i].info,
+                         sink->results[i].matches);
+        }
+    }
+    for (int i = 0; i < sink->stored_count; i++) {
+        free(sink->results[i].path);
+    }
+    free(sink->results);
+    sink->results = NULL;
+    sink->capacity = 0;
+    
+    if (sink->exec) {
+        exec_finish(sink->exec);
+    } else if (sink->result_count > 0) {
+        printf("\n");
+    }
+    
     // 显示统计信息
     if (opts->show_stats) {
         if (opts->color_output) {
             color_print(COLOR_BRIGHT_CYAN, "找到 ");
-            color_print(COLOR_BRIGHT_GREEN, "%d", result_count);
+            color_print(COLOR_BRIGHT_GREEN, "%d", sink->result_count);
             color_print(COLOR_BRIGHT_CYAN, " 个项目");
-            if (file_count > 0) {
+            if (sink->file_count > 0) {
                 printf(" (");
-                color_print(COLOR_BRIGHT_GREEN, "%d", file_count);
+                color_print(COLOR_BRIGHT_GREEN, "%d", sink->file_count);
                 printf(" 个文件");
             }
-            if (dir_count > 0) {
+            if (sink->dir_count > 0) {
                 printf(", ");
-                color_print(COLOR_BRIGHT_BLUE, "%d", dir_count);
+                color_print(COLOR_BRIGHT_BLUE, "%d", sink->dir_count);
                 printf(" 个目录");
             }
-            printf(")\n\n");
+            printf(")\n");
         } else {
-            printf("找到 %d 个项目", result_count);
-            if (file_count > 0) {
-                printf(" (%d 个文件", file_count);
-                if (dir_count > 0) {
-                    printf(", %d 个目录", dir_count);
+            printf("找到 %d 个项目", sink->result_count);
+            if (sink->file_count > 0) {
+                printf(" (%d 个文件", sink->file_count);
+                if (sink->dir_count > 0) {
+                    printf(", %d 个目录", sink->dir_count);
                 }
                 printf(")");
             }
-            printf("\n\n");
+            printf("\n");
+        }
+    }
+}
+
+// 搜索上下文（目录遍历线程与内容搜索线程共享）
+typedef struct {
+    Options *opts;
+    ResultSink *sink;
+    ContentMatcher *matcher;    // 内容匹配器（无 -content 时为 NULL）
+    WorkPool *pool;             // 内容搜索线程池
+} SearchContext;
+
+// 内容搜索任务
+typedef struct {
+    SearchContext *ctx;
+    char *path;
+    struct stat info;
+} ContentTask;
+
+static void content_task_run(void *arg) {
+    ContentTask *task = arg;
+    int match_count = 0;
+    
+    if (search_content(task->ctx->matcher, task->path, &match_count) && match_count > 0) {
+        sink_emit(task->ctx->sink, task->path, &task->info, match_count);
+    }
+    
+    free(task->path);
+    free(task);
+}
+
+// 把内容过滤交给线程池，遍历线程继续向下走
+static void submit_content_search(SearchContext *ctx, const char *path, struct stat *st) {
+    ContentTask *task = malloc(sizeof(ContentTask));
+    if (task) {
+        task->ctx = ctx;
+        task->path = strdup(path);
+        task->info = *st;
+    }
+    
+    if (!task || !task->path || !workpool_submit(ctx->pool, content_task_run, task)) {
+        // 无法排队时在当前线程完成
+        int match_count = 0;
+        if (search_content(ctx->matcher, path, &match_count) && match_count > 0) {
+            sink_emit(ctx->sink, path, st, match_count);
+        }
+        if (task) free(task->path);
+        free(task);
+    }
+}
+
+// 递归搜索目录
+static void search_directory(const char *path, SearchContext *ctx, int depth) {
+    Options *opts = ctx->opts;
+    DIR *dir = opendir(path);
+    if (!dir) return;
+    
+    struct dirent *entry;
+    
+    while ((entry = readdir(dir)) != NULL) {
+        // 跳过 . 和 ..
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        
+        char full_path[4096];
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+        
+        struct stat st;
+        if (lstat(full_path, &st) == -1) {
+            continue;
+        }
+        
+        // 检查文件名匹配
+        if (!match_name(entry->d_name, opts)) {
+            goto check_recursive;
+        }
+        
+        // 检查文件类型
+        if (!match_type(opts->type_filter, st.st_mode)) {
+            goto check_recursive;
+        }
+        
+        // 检查文件大小
+        if (!match_size(opts->size_filter, st.st_size)) {
+            goto check_recursive;
+        }
+        
+        // 检查修改时间
+        if (!match_time(opts->time_filter, st.st_mtime)) {
+            goto check_recursive;
+        }
+        
+        // 如果是文件，交给内容搜索线程
+        if (S_ISREG(st.st_mode) && ctx->matcher) {
+            submit_content_search(ctx, full_path, &st);
+            goto check_recursive;
+        }
+        
+        sink_emit(ctx->sink, full_path, &st, 0);
+        
+    check_recursive:
+        // 递归搜索子目录
+        if (S_ISDIR(st.st_mode) && opts->recursive && 
+            (opts->max_depth == -1 || depth < opts->max_depth)) {
+            search_directory(full_path, ctx, depth + 1);
+        }
+    }
+    
+    closedir(dir);
+}
+
+// (设备, inode) 集合，用于硬链接去重
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    int used;
+} InodeSlot;
+
+typedef struct {
+    InodeSlot *slots;
+    size_t capacity;        // 2 的幂
+    size_t count;
+    pthread_mutex_t lock;
+} InodeSet;
+
+static size_t inode_slot_index(dev_t dev, ino_t ino, size_t capacity) {
+    uint64_t key[2] = {(uint64_t)dev, (uint64_t)ino};
+    return hash64(key, sizeof(key), 0) & (capacity - 1);
+}
+
+// 插入 (dev, ino)，已存在时返回 0
+static int inode_set_insert(InodeSet *set, dev_t dev, ino_t ino) {
+    pthread_mutex_lock(&set->lock);
+    
+    // 负载超过 70% 时扩容
+    if ((set->count + 1) * 10 > set->capacity * 7) {
+        size_t new_capacity = set->capacity ? set->capacity * 2 : 1024;
+        InodeSlot *slots = calloc(new_capacity, sizeof(InodeSlot));
+        if (!slots) {
+            pthread_mutex_unlock(&set->lock);
+            return 1;
+        }
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (!set->slots[i].used) continue;
+            size_t j = inode_slot_index(set->slots[i].dev, set->slots[i].ino, new_capacity);
+            while (slots[j].used) j = (j + 1) & (new_capacity - 1);
+            slots[j] = set->slots[i];
+        }
+        free(set->slots);
+        set->slots = slots;
+        set->capacity = new_capacity;
+    }
+    
+    size_t i = inode_slot_index(dev, ino, set->capacity);
+    while (set->slots[i].used) {
+        if (set->slots[i].dev == dev && set->slots[i].ino == ino) {
+            pthread_mutex_unlock(&set->lock);
+            return 0;
+        }
+        i = (i + 1) & (set->capacity - 1);
+    }
+    set->slots[i].dev = dev;
+    set->slots[i].ino = ino;
+    set->slots[i].used = 1;
+    set->count++;
+    
+    pthread_mutex_unlock(&set->lock);
+    return 1;
+}
+
+// --du 目录节点
+typedef struct {
+    char *path;
+    int parent;             // 父目录下标（根为 -1），总是小于自身下标
+    int depth;              // 相对搜索根的深度
+    long long apparent;     // 表观大小（st_size 之和）
+    long long allocated;    // 实际占用（st_blocks * 512 之和）
+    long long files;        // 文件数
+    long long dirs;         // 子目录数
+} DuNode;
+
+typedef struct {
+    Options *opts;
+    WorkPool *pool;
+    InodeSet seen;          // 已统计过的多链接 inode
+    pthread_mutex_t lock;   // 保护节点表
+    DuNode *nodes;
+    int node_count;
+    int node_capacity;
+} DuContext;
+
+// 目录扫描任务
+typedef struct {
+    DuContext *ctx;
+    int index;
+} DuTask;
+
+static void du_scan_directory(void *arg);
+
+// 登记目录节点并提交扫描任务，目录自身的大小计入该节点
+static void du_add_directory(DuContext *ctx, const char *path, int parent,
+                             int depth, struct stat *st) {
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->node_count >= ctx->node_capacity) {
+        int new_capacity = ctx->node_capacity ? ctx->node_capacity * 2 : 1024;
+        DuNode *grown = realloc(ctx->nodes, sizeof(DuNode) * new_capacity);
+        if (!grown) {
+            pthread_mutex_unlock(&ctx->lock);
+            print_error("内存不足，跳过目录: %s", path);
+            return;
         }
+        ctx->nodes = grown;
+        ctx->node_capacity = new_capacity;
     }
     
-    // 显示结果
-    for (int i = 0; i < result_count; i++) {
-        SearchResult *result = &results[i];
+    int index = ctx->node_count++;
+    DuNode *node = &ctx->nodes[index];
+    node->path = strdup(path);
+    node->parent = parent;
+    node->depth = depth;
+    node->apparent = st->st_size;
+    node->allocated = (long long)st->st_blocks * 512;
+    node->files = 0;
+    node->dirs = 0;
+    pthread_mutex_unlock(&ctx->lock);
+    
+    DuTask *task = malloc(sizeof(DuTask));
+    if (!task) return;
+    task->ctx = ctx;
+    task->index = index;
+    if (!ctx->pool || !workpool_submit(ctx->pool, du_scan_directory, task)) {
+        du_scan_directory(task);
+    }
+}
+
+// 扫描一个目录：文件大小累加到本节点，子目录作为新任务
+static void du_scan_directory(void *arg) {
+    DuTask *task = arg;
+    DuContext *ctx = task->ctx;
+    Options *opts = ctx->opts;
+    int index = task->index;
+    free(task);
+    
+    pthread_mutex_lock(&ctx->lock);
+    const char *path = ctx->nodes[index].path;
+    int depth = ctx->nodes[index].depth;
+    pthread_mutex_unlock(&ctx->lock);
+    if (!path) return;
+    
+    DIR *dir = opendir(path);
+    if (!dir) return;
+    
+    long long apparent = 0, allocated = 0, files = 0, dirs = 0;
+    struct dirent *entry;
+    
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        
+        char full_path[4096];
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
         
-        if (opts->show_details) {
-            show_file_details(result->path, &result->info, opts);
+        struct stat st;
+        if (lstat(full_path, &st) == -1) {
+            continue;
+        }
+        
+        if (S_ISDIR(st.st_mode)) {
+            dirs++;
+            du_add_directory(ctx, full_path, index, depth + 1, &st);
+            continue;
+        }
+        
+        // 过滤条件只作用于文件
+        if (!match_name(entry->d_name, opts) ||
+            !match_size(opts->size_filter, st.st_size) ||
+            !match_time(opts->time_filter, st.st_mtime)) {
+            continue;
+        }
+        
+        // 硬链接只统计一次
+        if (st.st_nlink > 1 && !inode_set_insert(&ctx->seen, st.st_dev, st.st_ino)) {
+            continue;
+        }
+        
+        apparent += st.st_size;
+        allocated += (long long)st.st_blocks * 512;
+        files++;
+    }
+    
+    closedir(dir);
+    
+    pthread_mutex_lock(&ctx->lock);
+    DuNode *node = &ctx->nodes[index];
+    node->apparent += apparent;
+    node->allocated += allocated;
+    node->files += files;
+    node->dirs += dirs;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static int compare_du_nodes(const void *a, const void *b, void *arg) {
+    const DuNode *nodes = arg;
+    const DuNode *na = &nodes[*(const int *)a];
+    const DuNode *nb = &nodes[*(const int *)b];
+    if (na->allocated != nb->allocated) return na->allocated < nb->allocated ? 1 : -1;
+    return strcmp(na->path, nb->path);
+}
+
+// --du：一次并行遍历统计所有目录，按子树占用输出前 N 个
+static int run_disk_usage(Options *opts) {
+    DuContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.opts = opts;
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_mutex_init(&ctx.seen.lock, NULL);
+    ctx.pool = workpool_create(opts->jobs, 0);
+    
+    for (int i = 0; i < opts->path_count; i++) {
+        struct stat st;
+        if (lstat(opts->paths[i], &st) == -1 || !S_ISDIR(st.st_mode)) {
+            print_warning("不是目录: %s", opts->paths[i]);
+            continue;
+        }
+        du_add_directory(&ctx, opts->paths[i], -1, 0, &st);
+    }
+    
+    workpool_wait(ctx.pool);
+    workpool_destroy(ctx.pool);
+    
+    // 子节点下标总大于父节点，倒序一遍即可完成后序汇总
+    for (int i = ctx.node_count - 1; i >= 0; i--) {
+        int parent = ctx.nodes[i].parent;
+        if (parent < 0) continue;
+        ctx.nodes[parent].apparent += ctx.nodes[i].apparent;
+        ctx.nodes[parent].allocated += ctx.nodes[i].allocated;
+        ctx.nodes[parent].files += ctx.nodes[i].files;
+        ctx.nodes[parent].dirs += ctx.nodes[i].dirs;
+    }
+    
+    // 选出参与排名的目录（-maxdepth 限制显示深度）
+    int *order = malloc(sizeof(int) * (ctx.node_count > 0 ? ctx.node_count : 1));
+    int ranked = 0;
+    for (int i = 0; order && i < ctx.node_count; i++) {
+        if (opts->max_depth == -1 || ctx.nodes[i].depth <= opts->max_depth) {
+            order[ranked++] = i;
+        }
+    }
+    if (order) {
+        qsort_r(order, ranked, sizeof(int), compare_du_nodes, ctx.nodes);
+    }
+    
+    int top = opts->du_top > 0 && opts->du_top < ranked ? opts->du_top : ranked;
+    char allocated_str[32], apparent_str[32];
+    
+    if (opts->color_output) {
+        color_println(COLOR_BRIGHT_CYAN, "占用空间最大的 %d 个目录:", top);
+    } else {
+        printf("占用空间最大的 %d 个目录:\n", top);
+    }
+    printf("      占用   表观大小     文件数  路径\n");
+    
+    for (int i = 0; i < top; i++) {
+        DuNode *node = &ctx.nodes[order[i]];
+        snprintf(allocated_str, sizeof(allocated_str), "%s", format_size(node->allocated));
+        snprintf(apparent_str, sizeof(apparent_str), "%s", format_size(node->apparent));
+        
+        if (opts->color_output) {
+            printf("%s%10s%s %10s %10lld  %s%s%s\n", COLOR_BRIGHT_YELLOW, allocated_str,
+                   COLOR_RESET, apparent_str, node->files,
+                   COLOR_BRIGHT_BLUE, node->path, COLOR_RESET);
         } else {
-            if (opts->color_output) {
-                const char *color = get_file_color(result->info.st_mode);
-                printf("%s%s%s\n", color, result->path, COLOR_RESET);
-            } else {
-                printf("%s\n", result->path);
-            }
+            printf("%10s %10s %10lld  %s\n", allocated_str, apparent_str,
+                   node->files, node->path);
         }
     }
     
-    if (result_count > 0 && !opts->show_stats) {
+    // 各搜索根的总计
+    if (opts->show_stats || opts->path_count > 1) {
         printf("\n");
+        for (int i = 0; i < ctx.node_count; i++) {
+            DuNode *node = &ctx.nodes[i];
+            if (node->parent >= 0) continue;
+            snprintf(allocated_str, sizeof(allocated_str), "%s", format_size(node->allocated));
+            snprintf(apparent_str, sizeof(apparent_str), "%s", format_size(node->apparent));
+            printf("总计 %s: 占用 %s, 表观 %s, %lld 个文件, %lld 个目录\n", node->path,
+                   allocated_str, apparent_str, node->files, node->dirs);
+        }
+    }
+    
+    for (int i = 0; i < ctx.node_count; i++) {
+        free(ctx.nodes[i].path);
     }
+    free(ctx.nodes);
+    free(order);
+    free(ctx.seen.slots);
+    pthread_mutex_destroy(&ctx.seen.lock);
+    pthread_mutex_destroy(&ctx.lock);
+    
+    return 0;
 }
 
 // tkfind主函数
@@ -616,11 +1680,44 @@ int tkfind_main(int argc, char **argv) {
         printf("\n");
     }
     
+    if (!compile_name_pattern(&opts)) {
+        free(opts.paths);
+        return 1;
+    }
+    
+    if (opts.disk_usage) {
+        int result = run_disk_usage(&opts);
+        if (opts.name_compiled) regfree(&opts.name_regex);
+        free(opts.paths);
+        return result;
+    }
+    
+    // 结果边找边输出
+    ResultSink sink = {0};
+    sink.opts = &opts;
+    pthread_mutex_init(&sink.lock, NULL);
+    
+    ExecRunner runner;
+    if (opts.exec_argv) {
+        exec_runner_init(&runner, &opts);
+        sink.exec = &runner;
+    }
+    
+    SearchContext ctx = {&opts, &sink, NULL, NULL};
+    ContentMatcher matcher;
+    if (opts.content_pattern) {
+        int jobs = opts.jobs > 0 ? opts.jobs : workpool_cpu_count();
+        if (!content_matcher_init(&matcher, opts.content_pattern, opts.ignore_case,
+                                  opts.count_matches, jobs)) {
+            content_matcher_free(&matcher);
+            free(opts.paths);
+            return 1;
+        }
+        ctx.matcher = &matcher;
+        ctx.pool = workpool_create(jobs, jobs * 64);
+    }
+    
     // 搜索所有路径
-    SearchResult *results = NULL;
-    int result_count = 0;
-    int total_files = 0;
-    int total_dirs = 0;
     
     for (int i = 0; i < opts.path_count; i++) {
         const char *path = opts.paths[i];
@@ -638,52 +1735,41 @@ int tkfind_main(int argc, char **argv) {
         
         if (S_ISDIR(st.st_mode)) {
             // 搜索目录
-            int dir_files = 0, dir_dirs = 0;
-            search_directory(path, &opts, 0, -1, &results, &result_count, 
-                           &dir_files, &dir_dirs);
-            total_files += dir_files;
-            total_dirs += dir_dirs;
+            search_directory(path, &ctx, 0);
         } else {
             // 单个文件
-            if (match_name(path, opts.name_pattern, opts.regex_mode, opts.ignore_case) &&
+            if (match_name(path, &opts) &&
                 match_type(opts.type_filter, st.st_mode) &&
                 match_size(opts.size_filter, st.st_size) &&
                 match_time(opts.time_filter, st.st_mtime)) {
                 
                 if (opts.content_pattern) {
                     int match_count = 0;
-                    if (search_content(path, opts.content_pattern, opts.ignore_case, &match_count) && 
+                    if (search_content(&matcher, path, &match_count) && 
                         match_count > 0) {
-                        result_count++;
-                        results = realloc(results, sizeof(SearchResult) * result_count);
-                        SearchResult *result = &results[result_count - 1];
-                        result->path = strdup(path);
-                        result->info = st;
-                        result->matches = match_count;
-                        total_files++;
+                        sink_emit(&sink, path, &st, match_count);
                     }
                 } else {
-                    result_count++;
-                    results = realloc(results, sizeof(SearchResult) * result_count);
-                    SearchResult *result = &results[result_count - 1];
-                    result->path = strdup(path);
-                    result->info = st;
-                    result->matches = 0;
-                    total_files++;
+                    sink_emit(&sink, path, &st, 0);
                 }
             }
         }
     }
     
-    // 显示结果
-    show_results(results, result_count, &opts, total_files, total_dirs);
+    // 等待内容搜索线程结束
+    if (ctx.pool) {
+        workpool_wait(ctx.pool);
+        workpool_destroy(ctx.pool);
+    }
+    
+    // 输出排序结果和统计信息
+    sink_finish(&sink);
     
     // 清理
-    for (int i = 0; i < result_count; i++) {
-        free(results[i].path);
-    }
-    free(results);
+    if (ctx.matcher) content_matcher_free(&matcher);
+    if (opts.name_compiled) regfree(&opts.name_regex);
+    pthread_mutex_destroy(&sink.lock);
     if (opts.paths) free(opts.paths);
     
-    return 0;
-}
\ No newline at end of file
+    return sink.exec && runner.failed > 0 ? 1 : 0;
+}
\ No newline at end of file
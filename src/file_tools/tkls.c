@@ -11,16 +11,56 @@
 #include <time.h>
 #include <errno.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <locale.h>
+#include <stdint.h>
+#include <sys/mman.h>
 #include "../common/colors.h"
 #include "../common/utils.h"
+#include "../common/workpool.h"
+#include "../common/hash.h"
 
-// 文件信息结构
+#define PARALLEL_STAT_MIN 1024  // 条目数达到该值时并行 stat
+#define STAT_CHUNK_SIZE 256     // 每个 stat 任务处理的条目数
+#define STREAM_WINDOW 4096      // -U 每批输出的条目数
+#define PREFETCH_AHEAD 16       // -R 每个目录提前读取的子目录数
+#define PREFETCH_THREADS 8      // -R 预读线程数下限（等待的是元数据延迟而非CPU）
+
+// 输出需要的文件信息程度
+enum {
+    STAT_NONE = 0,              // d_type 即可（名称和类型）
+    STAT_MODE = 1,              // 需要权限位（可执行文件的颜色/图标/标识）
+    STAT_FULL = 2               // 需要完整信息（-l, -t, -i）
+};
+
+// 精简的文件元数据（只保留 tkls 用到的 stat 字段）
 typedef struct {
-    char name[256];
-    struct stat info;
-    int is_hidden;
+    mode_t mode;
+    nlink_t nlink;
+    uid_t uid;
+    gid_t gid;
+    off_t size;
+    blkcnt_t blocks;
+    time_t mtime;
+    long mtime_nsec;
+    ino_t ino;
     char type_indicator;
-} FileEntry;
+    char git_status;        // --git 状态字母（0 表示不在仓库中）
+} FileMeta;
+
+// 目录列表：名称存放在字符串池中，元数据单独成数组，排序只交换下标
+typedef struct {
+    char *names;            // 字符串池，名称以 '\0' 分隔
+    size_t names_used;
+    size_t names_capacity;
+    size_t *name_offsets;   // 每个条目名称在字符串池中的偏移
+    FileMeta *meta;         // 每个条目的元数据
+    int *order;             // 排序后的条目下标
+    int count;
+    int capacity;
+} FileList;
 
 // 选项结构
 typedef struct {
@@ -33,9 +73,15 @@ typedef struct {
     int classify;        // -F 添加类型标识
     int show_inode;      // -i 显示inode
     int one_per_line;    // -1 每行一个
+    int unsorted;        // -U 不排序，边读边输出
+    int natural_sort;    // -v 自然排序（文件名中的数字按数值比较）
+    int locale_sort;     // --locale 按区域设置排序
     int color;           // 颜色显示
     int show_icons;      // 显示图标
-    int show_git;        // 显示git状态（预留）
+    int show_git;        // --git 显示git状态
+    int tree_view;       // --tree 树形视图
+    int max_depth;       // --depth 显示的最大层数（-1 不限制）
+    int tree_top;        // --top 每个目录只显示最大的 N 项（0 不限制）
 } Options;
 
 // 初始化选项
@@ -49,9 +95,15 @@ static void init_options(Options *opts) {
     opts->classify = 0;
     opts->show_inode = 0;
     opts->one_per_line = 0;
+    opts->unsorted = 0;
+    opts->natural_sort = 0;
+    opts->locale_sort = 0;
     opts->color = is_color_supported();  // 自动检测颜色支持
     opts->show_icons = 1;  // 默认显示图标
-    opts->show_git = 0;    // 简化版不显示git状态
+    opts->show_git = 0;    // 读取索引有额外开销，默认关闭
+    opts->tree_view = 0;
+    opts->max_depth = -1;
+    opts->tree_top = 0;
 }
 
 // 显示帮助
@@ -70,8 +122,15 @@ static void show_help(void) {
     printf("  -F, --classify     添加文件类型标识符 (*/@/=等)\n");
     printf("  -i                 显示inode号\n");
     printf("  -1                 每行只显示一个文件\n");
+    printf("  -U                 不排序，按目录顺序边读边输出（适合超大目录）\n");
+    printf("  -v                 自然排序，file2 排在 file10 之前\n");
+    printf("      --locale       按当前区域设置 (LC_COLLATE) 排序文件名\n");
     printf("      --no-color     禁用彩色输出\n");
     printf("      --no-icons     禁用图标显示\n");
+    printf("      --git          长格式中显示git状态 (M 修改, ? 未跟踪, U 冲突)\n");
+    printf("      --tree         树形显示，目录后附子树总大小和文件数\n");
+    printf("      --depth N      --tree/-R 最多显示 N 层子目录（大小仍统计全部）\n");
+    printf("      --top N        --tree 每个目录只显示最大的 N 项\n");
     printf("      --help         显示此帮助信息\n");
     printf("      --version      显示版本信息\n");
     printf("\n");
@@ -117,12 +176,30 @@ static int parse_options(int argc, char **argv, Options *opts, char ***paths, in
                 opts->classify = 1;
             } else if (strcmp(argv[i], "-i") == 0) {
                 opts->show_inode = 1;
+            } else if (strcmp(argv[i], "-U") == 0) {
+                opts->unsorted = 1;
+            } else if (strcmp(argv[i], "-v") == 0) {
+                opts->natural_sort = 1;
+            } else if (strcmp(argv[i], "--locale") == 0) {
+                opts->locale_sort = 1;
             } else if (strcmp(argv[i], "-1") == 0) {
                 opts->one_per_line = 1;
             } else if (strcmp(argv[i], "--no-color") == 0) {
                 opts->color = 0;
             } else if (strcmp(argv[i], "--no-icons") == 0) {
                 opts->show_icons = 0;
+            } else if (strcmp(argv[i], "--git") == 0) {
+                opts->show_git = 1;
+            } else if (strcmp(argv[i], "--tree") == 0) {
+                opts->tree_view = 1;
+            } else if (strcmp(argv[i], "--depth") == 0) {
+                if (i + 1 < argc) {
+                    opts->max_depth = atoi(argv[++i]);
+                }
+            } else if (strcmp(argv[i], "--top") == 0) {
+                if (i + 1 < argc) {
+                    opts->tree_top = atoi(argv[++i]);
+                }
             } else if (strcmp(argv[i], "--help") == 0) {
                 show_help();
                 return 0; // 特殊返回，表示不需要继续执行
@@ -255,20 +332,633 @@ static const char* get_file_color(mode_t mode) {
     return COLOR_WHITE;
 }
 
-// 收集目录中的文件
-static int collect_files(const char *path, Options *opts, FileEntry **files) {
-    DIR *dir = opendir(path);
-    if (dir == NULL) {
-        print_error("无法打开目录 '%s': %s", path, strerror(errno));
+// 初始化文件列表
+static void file_list_init(FileList *list) {
+    memset(list, 0, sizeof(*list));
+}
+
+// 清空条目但保留已分配的空间
+static void file_list_reset(FileList *list) {
+    list->count = 0;
+    list->names_used = 0;
+}
+
+// 释放文件列表
+static void file_list_free(FileList *list) {
+    free(list->names);
+    free(list->name_offsets);
+    free(list->meta);
+    free(list->order);
+    file_list_init(list);
+}
+
+// 条目名称
+static inline const char* file_name(const FileList *list, int index) {
+    return list->names + list->name_offsets[index];
+}
+
+// 用 stat 结果填充元数据
+static void file_meta_set_stat(FileMeta *fm, const struct stat *st) {
+    fm->mode = st->st_mode;
+    fm->nlink = st->st_nlink;
+    fm->uid = st->st_uid;
+    fm->gid = st->st_gid;
+    fm->size = st->st_size;
+    fm->blocks = st->st_blocks;
+    fm->mtime = st->st_mtime;
+    fm->mtime_nsec = st->st_mtim.tv_nsec;
+    fm->ino = st->st_ino;
+    fm->type_indicator = get_type_indicator(st->st_mode);
+}
+
+// 添加条目；type 为 d_type 换算出的文件类型位，0 表示未知
+static int file_list_add(FileList *list, const char *name, mode_t type) {
+    if (list->count >= list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 64;
+        size_t *offsets = realloc(list->name_offsets, sizeof(size_t) * new_capacity);
+        if (offsets == NULL) return 0;
+        list->name_offsets = offsets;
+        FileMeta *meta = realloc(list->meta, sizeof(FileMeta) * new_capacity);
+        if (meta == NULL) return 0;
+        list->meta = meta;
+        int *order = realloc(list->order, sizeof(int) * new_capacity);
+        if (order == NULL) return 0;
+        list->order = order;
+        list->capacity = new_capacity;
+    }
+    
+    size_t len = strlen(name) + 1;
+    if (list->names_used + len > list->names_capacity) {
+        size_t new_capacity = list->names_capacity ? list->names_capacity * 2 : 4096;
+        while (new_capacity < list->names_used + len) new_capacity *= 2;
+        char *names = realloc(list->names, new_capacity);
+        if (names == NULL) return 0;
+        list->names = names;
+        list->names_capacity = new_capacity;
+    }
+    
+    int index = list->count;
+    list->name_offsets[index] = list->names_used;
+    memcpy(list->names + list->names_used, name, len);
+    list->names_used += len;
+    
+    FileMeta *fm = &list->meta[index];
+    memset(fm, 0, sizeof(*fm));
+    fm->mode = type;
+    fm->type_indicator = type ? get_type_indicator(type) : '?';
+    
+    list->order[index] = index;
+    list->count++;
+    return 1;
+}
+
+// 计算当前输出需要的文件信息程度
+static int required_stat_level(Options *opts) {
+    if (opts->long_format || opts->one_per_line || opts->sort_by_time ||
+        opts->show_inode || opts->show_git || opts->tree_view) {
+        return STAT_FULL;
+    }
+    if (opts->color || opts->show_icons || opts->classify) {
+        return STAT_MODE;
+    }
+    return STAT_NONE;
+}
+
+// 该条目是否需要 stat：d_type 已给出目录/链接类型时，仅权限位用途可以省略
+static int entry_needs_stat(const FileMeta *fm, int level) {
+    if (level == STAT_FULL || (fm->mode & S_IFMT) == 0) return 1;
+    if (level == STAT_MODE) return !S_ISDIR(fm->mode) && !S_ISLNK(fm->mode);
+    return 0;
+}
+
+// 用 statx 只请求需要的字段，内核不支持时退回 fstatat
+static void stat_entry(int dir_fd, const char *name, int level, FileMeta *fm) {
+    unsigned int mask = STATX_TYPE | STATX_MODE;
+    if (level == STAT_FULL) {
+        mask |= STATX_NLINK | STATX_UID | STATX_GID | STATX_SIZE |
+                STATX_BLOCKS | STATX_MTIME | STATX_INO;
+    }
+    
+    struct statx stx;
+    if (statx(dir_fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, mask, &stx) == 0) {
+        fm->mode = stx.stx_mode;
+        fm->nlink = stx.stx_nlink;
+        fm->uid = stx.stx_uid;
+        fm->gid = stx.stx_gid;
+        fm->size = stx.stx_size;
+        fm->blocks = stx.stx_blocks;
+        fm->mtime = stx.stx_mtime.tv_sec;
+        fm->mtime_nsec = stx.stx_mtime.tv_nsec;
+        fm->ino = stx.stx_ino;
+        fm->type_indicator = get_type_indicator(fm->mode);
+        return;
+    }
+    
+    struct stat st;
+    if (errno == ENOSYS && fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+        file_meta_set_stat(fm, &st);
+    } else {
+        fm->type_indicator = '?';
+    }
+}
+
+// 一段条目的 stat 任务
+typedef struct {
+    FileList *list;
+    int dir_fd;
+    int level;
+    int start;
+    int end;
+    int *pending;       // 本批尚未完成的任务数
+} StatTask;
+
+// 所有 -R 层级共用的 stat 线程池；各批次只等待自己的任务
+static WorkPool *stat_pool = NULL;
+static pthread_mutex_t stat_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stat_done = PTHREAD_COND_INITIALIZER;
+
+static void stat_range(void *arg) {
+    StatTask *task = arg;
+    for (int i = task->start; i < task->end; i++) {
+        FileMeta *fm = &task->list->meta[i];
+        if (entry_needs_stat(fm, task->level)) {
+            stat_entry(task->dir_fd, file_name(task->list, i), task->level, fm);
+        }
+    }
+}
+
+static void stat_task(void *arg) {
+    StatTask *task = arg;
+    stat_range(task);
+    
+    pthread_mutex_lock(&stat_lock);
+    if (--*task->pending == 0) pthread_cond_broadcast(&stat_done);
+    pthread_mutex_unlock(&stat_lock);
+}
+
+// 补齐需要的文件信息，条目较多时分块并行
+static void stat_files(FileList *list, int dir_fd, int level) {
+    int count = list->count;
+    
+    if (count < PARALLEL_STAT_MIN) {
+        StatTask task = {list, dir_fd, level, 0, count, NULL};
+        stat_range(&task);
+        return;
+    }
+    
+    if (stat_pool == NULL) {
+        stat_pool = workpool_create(0, 0);
+    }
+    
+    // 线程池由 -R 预读线程共用，workpool_wait 会等到别的目录的任务，这里只计本批
+    int chunks = (count + STAT_CHUNK_SIZE - 1) / STAT_CHUNK_SIZE;
+    StatTask *tasks = malloc(sizeof(StatTask) * chunks);
+    int pending = 0;
+    for (int c = 0; c < chunks; c++) {
+        StatTask task = {list, dir_fd, level, c * STAT_CHUNK_SIZE,
+                         (c + 1) * STAT_CHUNK_SIZE < count ? (c + 1) * STAT_CHUNK_SIZE : count,
+                         &pending};
+        if (tasks == NULL || stat_pool == NULL) {
+            stat_range(&task);
+            continue;
+        }
+        tasks[c] = task;
+        pthread_mutex_lock(&stat_lock);
+        pending++;
+        pthread_mutex_unlock(&stat_lock);
+        if (!workpool_submit(stat_pool, stat_task, &tasks[c])) {
+            stat_task(&tasks[c]);
+        }
+    }
+    
+    pthread_mutex_lock(&stat_lock);
+    while (pending > 0) {
+        pthread_cond_wait(&stat_done, &stat_lock);
+    }
+    pthread_mutex_unlock(&stat_lock);
+    free(tasks);
+}
+
+// ========== git 状态（直接读取 .git/index） ==========
+
+// 索引条目
+typedef struct {
+    const char *path;       // 相对仓库根目录的路径（不以 '\0' 结尾）
+    int path_len;
+    uint32_t mtime_sec;
+    uint32_t mtime_nsec;
+    uint32_t ino;
+    uint32_t mode;
+    uint32_t size;
+    unsigned char sha1[20];
+    int stage;              // 非 0 表示合并冲突
+} GitIndexEntry;
+
+// 已加载的仓库，按工作区根目录缓存，-R 时复用
+typedef struct GitRepo {
+    char *root;             // 工作区根目录（绝对路径）
+    size_t root_len;
+    unsigned char *map;     // 映射的索引文件
+    size_t map_size;
+    GitIndexEntry *entries; // 按路径字节序排列（与索引文件一致）
+    int entry_count;
+    char *v4_paths;         // v4 索引前缀压缩，解压后的路径存放在这里
+    time_t index_mtime;     // 不早于此时间修改的文件需要重新哈希
+    struct GitRepo *next;
+} GitRepo;
+
+static GitRepo *git_repos = NULL;
+static pthread_mutex_t git_lock = PTHREAD_MUTEX_INITIALIZER;  // -R 预读线程共用缓存
+
+static uint32_t read_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// 解析索引文件（支持 v2/v3/v4，仅 SHA-1 仓库）
+static int git_load_index(GitRepo *repo, const char *index_path) {
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0) return 0;
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < 32) {
+        close(fd);
         return 0;
     }
     
-    int count = 0;
-    int capacity = 16;
-    *files = malloc(sizeof(FileEntry) * capacity);
-    if (*files == NULL) {
-        closedir(dir);
-        print_error("内存分配失败");
+    repo->map_size = st.st_size;
+    repo->index_mtime = st.st_mtime;
+    repo->map = mmap(NULL, repo->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (repo->map == MAP_FAILED) {
+        repo->map = NULL;
+        return 0;
+    }
+    
+    const unsigned char *p = repo->map;
+    const unsigned char *end = repo->map + repo->map_size - 20;  // 末尾是校验和
+    uint32_t version = read_be32(p + 4);
+    uint32_t count = read_be32(p + 8);
+    if (memcmp(p, "DIRC", 4) != 0 || version < 2 || version > 4) {
+        return 0;
+    }
+    
+    repo->entries = calloc(count > 0 ? count : 1, sizeof(GitIndexEntry));
+    if (repo->entries == NULL) return 0;
+    
+    size_t *v4_offsets = NULL;
+    size_t v4_used = 0, v4_capacity = 0;
+    if (version == 4) {
+        v4_offsets = malloc(sizeof(size_t) * (count > 0 ? count : 1));
+        if (v4_offsets == NULL) return 0;
+    }
+    
+    p += 12;
+    const char *prev = "";
+    size_t prev_len = 0;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        if (p + 62 > end) break;
+        
+        GitIndexEntry *e = &repo->entries[i];
+        e->mtime_sec = read_be32(p + 8);
+        e->mtime_nsec = read_be32(p + 12);
+        e->ino = read_be32(p + 20);
+        e->mode = read_be32(p + 24);
+        e->size = read_be32(p + 36);
+        memcpy(e->sha1, p + 40, 20);
+        
+        uint16_t flags = (p[60] << 8) | p[61];
+        e->stage = (flags >> 12) & 3;
+        const unsigned char *name = p + 62;
+        if (version >= 3 && (flags & 0x4000)) name += 2;  // 扩展标志
+        if (name >= end) break;
+        
+        if (version < 4) {
+            const unsigned char *nul = memchr(name, '\0', end - name);
+            if (nul == NULL) break;
+            e->path = (const char *)name;
+            e->path_len = nul - name;
+            // 条目按 8 字节对齐，至少有一个 '\0'
+            p += ((name - p) + e->path_len + 8) & ~(size_t)7;
+        } else {
+            // v4：先去掉上一路径末尾若干字节，再接上新的后缀
+            unsigned char c = *name++;
+            size_t strip = c & 127;
+            while ((c & 128) && name < end) {
+                c = *name++;
+                strip = ((strip + 1) << 7) | (c & 127);
+            }
+            const unsigned char *nul = memchr(name, '\0', end - name);
+            if (nul == NULL || strip > prev_len) break;
+            
+            size_t keep = prev_len - strip;
+            size_t suffix_len = nul - name;
+            if (v4_used + keep + suffix_len + 1 > v4_capacity) {
+                size_t new_capacity = v4_capacity ? v4_capacity * 2 : 65536;
+                while (new_capacity < v4_used + keep + suffix_len + 1) new_capacity *= 2;
+                size_t prev_offset = i > 0 ? (size_t)(prev - repo->v4_paths) : 0;
+                char *grown = realloc(repo->v4_paths, new_capacity);
+                if (grown == NULL) break;
+                if (i > 0) prev = grown + prev_offset;
+                repo->v4_paths = grown;
+                v4_capacity = new_capacity;
+            }
+            
+            char *dest = repo->v4_paths + v4_used;
+            memmove(dest, prev, keep);
+            memcpy(dest + keep, name, suffix_len);
+            dest[keep + suffix_len] = '\0';
+            v4_offsets[i] = v4_used;
+            e->path_len = keep + suffix_len;
+            prev = dest;
+            prev_len = e->path_len;
+            v4_used += e->path_len + 1;
+            p = nul + 1;
+        }
+        repo->entry_count++;
+    }
+    
+    // v4 路径缓冲区可能搬动过，最后统一换算成指针
+    if (version == 4) {
+        for (int i = 0; i < repo->entry_count; i++) {
+            repo->entries[i].path = repo->v4_paths + v4_offsets[i];
+        }
+        free(v4_offsets);
+    }
+    
+    return 1;
+}
+
+// 仓库是否使用 SHA-1 对象格式；路径过长无法确认时按不支持处理
+static int git_uses_sha1(const char *git_dir) {
+    char config_path[PATH_MAX];
+    int len = snprintf(config_path, sizeof(config_path), "%s/config", git_dir);
+    if (len < 0 || (size_t)len >= sizeof(config_path)) return 0;
+    FILE *config = fopen(config_path, "r");
+    if (config == NULL) return 1;
+    
+    char line[512];
+    int sha1 = 1;
+    while (fgets(line, sizeof(line), config)) {
+        if (strcasestr(line, "objectformat") && strstr(line, "sha256")) {
+            sha1 = 0;
+            break;
+        }
+    }
+    fclose(config);
+    return sha1;
+}
+
+// 加载 root 下的仓库；.git 可能是目录，也可能是指向 gitdir 的文件
+static GitRepo* git_open_repo(const char *root, const char *dot_git, int is_dir) {
+    char git_dir[PATH_MAX];
+    int len;
+    
+    if (is_dir) {
+        len = snprintf(git_dir, sizeof(git_dir), "%s", dot_git);
+    } else {
+        FILE *file = fopen(dot_git, "r");
+        if (file == NULL) return NULL;
+        char line[PATH_MAX];
+        int ok = fgets(line, sizeof(line), file) != NULL && starts_with(line, "gitdir:");
+        fclose(file);
+        if (!ok) return NULL;
+        
+        char *target = line + 7;
+        trim_string(target);
+        if (target[0] == '/') {
+            len = snprintf(git_dir, sizeof(git_dir), "%s", target);
+        } else {
+            len = snprintf(git_dir, sizeof(git_dir), "%s/%s", root, target);
+        }
+    }
+    // 路径被截断时不能去读一个错误的仓库
+    if (len < 0 || (size_t)len >= sizeof(git_dir)) return NULL;
+    
+    GitRepo *repo = calloc(1, sizeof(GitRepo));
+    if (repo == NULL) return NULL;
+    repo->root = strdup(root);
+    repo->root_len = strlen(root);
+    
+    char index_path[PATH_MAX];
+    len = snprintf(index_path, sizeof(index_path), "%s/index", git_dir);
+    if (len < 0 || (size_t)len >= sizeof(index_path) ||
+        !git_uses_sha1(git_dir) || !git_load_index(repo, index_path)) {
+        // 无法解析时仍然缓存，避免重复尝试；条目为空时不显示状态
+        repo->entry_count = -1;
+    }
+    
+    repo->next = git_repos;
+    git_repos = repo;
+    return repo;
+}
+
+// 查找 dir 所在的仓库（向上寻找 .git，已加载的仓库直接复用）
+static GitRepo* git_find_repo(const char *real_dir) {
+    char probe[PATH_MAX];
+    snprintf(probe, sizeof(probe), "%s", real_dir);
+    
+    while (1) {
+        for (GitRepo *repo = git_repos; repo; repo = repo->next) {
+            if (strcmp(repo->root, probe) == 0) {
+                return repo->entry_count >= 0 ? repo : NULL;
+            }
+        }
+        
+        char dot_git[PATH_MAX + 8];
+        snprintf(dot_git, sizeof(dot_git), "%s/.git", strcmp(probe, "/") == 0 ? "" : probe);
+        struct stat st;
+        if (lstat(dot_git, &st) == 0) {
+            GitRepo *repo = git_open_repo(probe, dot_git, S_ISDIR(st.st_mode));
+            return repo && repo->entry_count >= 0 ? repo : NULL;
+        }
+        
+        char *slash = strrchr(probe, '/');
+        if (slash == NULL || slash == probe) break;
+        *slash = '\0';
+    }
+    
+    return NULL;
+}
+
+// 按字节序比较索引路径与 key
+static int git_path_compare(const GitIndexEntry *e, const char *key, size_t key_len) {
+    size_t n = (size_t)e->path_len < key_len ? (size_t)e->path_len : key_len;
+    int cmp = memcmp(e->path, key, n);
+    if (cmp != 0) return cmp;
+    return (size_t)e->path_len < key_len ? -1 : ((size_t)e->path_len > key_len ? 1 : 0);
+}
+
+// 第一个不小于 key 的条目
+static int git_lower_bound(GitRepo *repo, const char *key, size_t key_len) {
+    int lo = 0, hi = repo->entry_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (git_path_compare(&repo->entries[mid], key, key_len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// 计算工作区文件的 blob ID
+static int git_hash_blob(const char *path, const FileMeta *fm, unsigned char sha1[20]) {
+    Sha1Context ctx;
+    char header[32];
+    
+    if (S_ISLNK(fm->mode)) {
+        char target[PATH_MAX];
+        ssize_t len = readlink(path, target, sizeof(target));
+        if (len < 0) return 0;
+        int header_len = snprintf(header, sizeof(header), "blob %zd", len) + 1;
+        sha1_init(&ctx);
+        sha1_update(&ctx, header, header_len);
+        sha1_update(&ctx, target, len);
+        sha1_final(&ctx, sha1);
+        return 1;
+    }
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return 0;
+    }
+    
+    int header_len = snprintf(header, sizeof(header), "blob %lld", (long long)st.st_size) + 1;
+    sha1_init(&ctx);
+    sha1_update(&ctx, header, header_len);
+    
+    if (st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return 0;
+        }
+        sha1_update(&ctx, data, st.st_size);
+        munmap(data, st.st_size);
+    }
+    close(fd);
+    
+    sha1_final(&ctx, sha1);
+    return 1;
+}
+
+// 单个条目的状态：stat 信息与索引一致时直接认为未修改，否则才读取内容哈希
+static char git_entry_status(GitRepo *repo, const char *rel, size_t rel_len,
+                             const char *full_path, const FileMeta *fm) {
+    int i = git_lower_bound(repo, rel, rel_len);
+    int found = i < repo->entry_count && git_path_compare(&repo->entries[i], rel, rel_len) == 0;
+    int gitlink = found && (repo->entries[i].mode & 0170000) == 0160000;
+    
+    if (S_ISDIR(fm->mode)) {
+        // 子模块在索引中是同名的 gitlink 条目
+        if (gitlink) return repo->entries[i].stage != 0 ? 'U' : ' ';
+        
+        // 目录：索引中没有以 "rel/" 开头的路径即为未跟踪
+        char prefix[PATH_MAX];
+        if (rel_len + 1 >= sizeof(prefix)) return ' ';
+        memcpy(prefix, rel, rel_len);
+        prefix[rel_len] = '/';
+        int k = git_lower_bound(repo, prefix, rel_len + 1);
+        if (k < repo->entry_count && repo->entries[k].path_len > (int)rel_len &&
+            memcmp(repo->entries[k].path, prefix, rel_len + 1) == 0) {
+            return ' ';
+        }
+        return '?';
+    }
+    
+    if (!found) return '?';
+    
+    GitIndexEntry *e = &repo->entries[i];
+    if (e->stage != 0) return 'U';
+    if (gitlink) return 'M';    // 子模块被换成了普通文件
+    
+    // 类型或可执行位变化
+    int index_link = (e->mode & 0170000) == 0120000;
+    if (index_link != (S_ISLNK(fm->mode) != 0)) return 'M';
+    if (!index_link && ((e->mode & 0100) != 0) != ((fm->mode & S_IXUSR) != 0)) return 'M';
+    
+    // stat 数据一致且不是在索引写入之后修改的，认为未修改
+    if (e->size == (uint32_t)fm->size && e->mtime_sec == (uint32_t)fm->mtime &&
+        e->mtime_nsec == (uint32_t)fm->mtime_nsec && e->ino == (uint32_t)fm->ino &&
+        fm->mtime < repo->index_mtime) {
+        return ' ';
+    }
+    
+    // 大小不同必然已修改，否则比较内容哈希
+    if (e->size != (uint32_t)fm->size) return 'M';
+    
+    unsigned char sha1[20];
+    if (!git_hash_blob(full_path, fm, sha1)) return ' ';
+    return memcmp(sha1, e->sha1, 20) == 0 ? ' ' : 'M';
+}
+
+// 为目录中的条目标注 git 状态
+static void git_annotate(FileList *list, const char *path) {
+    char real_dir[PATH_MAX];
+    if (realpath(path, real_dir) == NULL) return;
+    
+    pthread_mutex_lock(&git_lock);
+    GitRepo *repo = git_find_repo(real_dir);
+    pthread_mutex_unlock(&git_lock);
+    if (repo == NULL) return;
+    
+    // 目录相对仓库根目录的路径
+    const char *rel_dir = real_dir + repo->root_len;
+    if (*rel_dir == '/') rel_dir++;
+    if (repo->root_len == 1) rel_dir = real_dir + 1;  // 仓库根是 "/"
+    size_t rel_dir_len = strlen(rel_dir);
+    
+    // .git 目录内部不属于工作区
+    if (starts_with(rel_dir, ".git") && (rel_dir[4] == '\0' || rel_dir[4] == '/')) return;
+    
+    for (int i = 0; i < list->count; i++) {
+        const char *name = file_name(list, i);
+        FileMeta *fm = &list->meta[i];
+        
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 ||
+            (rel_dir_len == 0 && strcmp(name, ".git") == 0)) {
+            fm->git_status = ' ';
+            continue;
+        }
+        
+        char rel[PATH_MAX];
+        int rel_len = rel_dir_len > 0
+            ? snprintf(rel, sizeof(rel), "%s/%s", rel_dir, name)
+            : snprintf(rel, sizeof(rel), "%s", name);
+        char full_path[PATH_MAX * 2];
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, name);
+        
+        if (rel_len > 0 && (size_t)rel_len < sizeof(rel)) {
+            fm->git_status = git_entry_status(repo, rel, rel_len, full_path, fm);
+        }
+    }
+}
+
+// 释放缓存的仓库
+static void git_free_repos(void) {
+    while (git_repos) {
+        GitRepo *repo = git_repos;
+        git_repos = repo->next;
+        if (repo->map) munmap(repo->map, repo->map_size);
+        free(repo->entries);
+        free(repo->v4_paths);
+        free(repo->root);
+        free(repo);
+    }
+}
+
+// 读取目录项，再按需要补充 stat
+// 不直接输出错误，失败时把 errno 存入 *error，供 -R 预读线程使用
+static int read_entries(const char *path, Options *opts, FileList *list, int *error) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        *error = errno;
         return 0;
     }
     
@@ -285,72 +975,304 @@ static int collect_files(const char *path, Options *opts, FileEntry **files) {
             continue;
         }
         
-        // 扩展数组
-        if (count >= capacity) {
-            capacity *= 2;
-            *files = realloc(*files, sizeof(FileEntry) * capacity);
-            if (*files == NULL) {
-                closedir(dir);
-                print_error("内存分配失败");
-                return 0;
-            }
+        mode_t type = entry->d_type != DT_UNKNOWN ? DTTOIF(entry->d_type) : 0;
+        if (!file_list_add(list, entry->d_name, type)) {
+            closedir(dir);
+            *error = ENOMEM;
+            return 0;
         }
-        
-        FileEntry *fe = &(*files)[count];
-        strncpy(fe->name, entry->d_name, sizeof(fe->name) - 1);
-        fe->name[sizeof(fe->name) - 1] = '\0';
-        fe->is_hidden = (entry->d_name[0] == '.');
-        
-        // 获取文件信息
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-        
-        if (lstat(full_path, &fe->info) == -1) {
-            fe->type_indicator = '?';
-        } else {
-            fe->type_indicator = get_type_indicator(fe->info.st_mode);
-        }
-        
-        count++;
+    }
+    
+    stat_files(list, dirfd(dir), required_stat_level(opts));
+    if (opts->show_git) {
+        git_annotate(list, path);
     }
     
     closedir(dir);
+    return list->count;
+}
+
+// 读取失败时的错误信息
+static void report_read_error(const char *path, int error) {
+    if (error == ENOMEM) {
+        print_error("内存分配失败");
+    } else if (error != 0) {
+        print_error("无法打开目录 '%s': %s", path, strerror(error));
+    }
+}
+
+// 收集目录中的文件
+static int collect_files(const char *path, Options *opts, FileList *list) {
+    int error = 0;
+    int count = read_entries(path, opts, list, &error);
+    if (error != 0) {
+        report_read_error(path, error);
+        errno = error;
+    }
     return count;
 }
 
-// 比较函数：按名称
-static int compare_name(const void *a, const void *b) {
-    const FileEntry *fa = (const FileEntry *)a;
-    const FileEntry *fb = (const FileEntry *)b;
-    return strcasecmp(fa->name, fb->name);
+// 名称排序键：排序前为每个名称算一次，比较时只做整数和 memcmp
+typedef struct {
+    uint64_t prefix;    // 键的前 8 字节（大端），大多数比较在这里分出大小
+    size_t offset;      // 在键缓冲区中的位置
+    size_t length;
+} SortKey;
+
+typedef struct {
+    const FileList *list;
+    const SortKey *keys;
+    const unsigned char *buffer;
+} KeyedSort;
+
+// 键缓冲区
+typedef struct {
+    unsigned char *data;
+    size_t used;
+    size_t capacity;
+} KeyBuffer;
+
+static int key_buffer_reserve(KeyBuffer *kb, size_t extra) {
+    if (kb->used + extra <= kb->capacity) return 1;
+    size_t new_capacity = kb->capacity ? kb->capacity * 2 : 65536;
+    while (new_capacity < kb->used + extra) new_capacity *= 2;
+    unsigned char *data = realloc(kb->data, new_capacity);
+    if (data == NULL) return 0;
+    kb->data = data;
+    kb->capacity = new_capacity;
+    return 1;
+}
+
+// 生成一个名称的排序键
+// 默认：转小写（与 strcasecmp 顺序一致）
+// -v：连续数字编码为 '0' + 有效位数 + 有效数字，数值大的键也大
+// --locale：strxfrm 的结果
+static int append_sort_key(KeyBuffer *kb, const char *name, Options *opts) {
+    size_t len = strlen(name);
+    
+    if (opts->locale_sort && !opts->natural_sort) {
+        size_t need = strxfrm(NULL, name, 0) + 1;
+        if (!key_buffer_reserve(kb, need)) return 0;
+        kb->used += strxfrm((char *)kb->data + kb->used, name, need);
+        return 1;
+    }
+    
+    // 每段数字最多多出 2 字节（标记和位数）
+    if (!key_buffer_reserve(kb, len * 2 + 2)) return 0;
+    unsigned char *out = kb->data + kb->used;
+    const unsigned char *p = (const unsigned char *)name;
+    
+    while (*p) {
+        if (opts->natural_sort && isdigit(*p)) {
+            while (*p == '0' && isdigit(p[1])) p++;  // 去掉前导零
+            const unsigned char *digits = p;
+            while (isdigit(*p)) p++;
+            size_t count = p - digits;
+            *out++ = '0';
+            *out++ = (unsigned char)(count > 255 ? 255 : count);
+            memcpy(out, digits, count);
+            out += count;
+        } else {
+            *out++ = tolower(*p);
+            p++;
+        }
+    }
+    
+    kb->used = out - kb->data;
+    return 1;
+}
+
+// 比较函数：按预先计算的名称键，键相同时按原始名称保证顺序确定
+static int compare_key(const void *a, const void *b, void *arg) {
+    const KeyedSort *ks = arg;
+    int ia = *(const int *)a;
+    int ib = *(const int *)b;
+    const SortKey *ka = &ks->keys[ia];
+    const SortKey *kb = &ks->keys[ib];
+    
+    if (ka->prefix != kb->prefix) return ka->prefix < kb->prefix ? -1 : 1;
+    
+    size_t n = ka->length < kb->length ? ka->length : kb->length;
+    if (n > 8) {
+        int cmp = memcmp(ks->buffer + ka->offset + 8, ks->buffer + kb->offset + 8, n - 8);
+        if (cmp != 0) return cmp;
+    }
+    if (ka->length != kb->length) return ka->length < kb->length ? -1 : 1;
+    
+    return strcmp(file_name(ks->list, ia), file_name(ks->list, ib));
+}
+
+// 按名称排序：先生成全部排序键，失败时退回逐次 strcasecmp
+static int compare_name(const void *a, const void *b, void *arg) {
+    const FileList *list = arg;
+    return strcasecmp(file_name(list, *(const int *)a), file_name(list, *(const int *)b));
+}
+
+static void sort_by_name(FileList *list, Options *opts) {
+    SortKey *keys = malloc(sizeof(SortKey) * (list->count > 0 ? list->count : 1));
+    KeyBuffer kb = {NULL, 0, 0};
+    
+    int ok = keys != NULL;
+    for (int i = 0; ok && i < list->count; i++) {
+        keys[i].offset = kb.used;
+        ok = append_sort_key(&kb, file_name(list, i), opts);
+        keys[i].length = kb.used - keys[i].offset;
+    }
+    
+    if (!ok) {
+        qsort_r(list->order, list->count, sizeof(int), compare_name, list);
+        free(keys);
+        free(kb.data);
+        return;
+    }
+    
+    for (int i = 0; i < list->count; i++) {
+        const unsigned char *key = kb.data + keys[i].offset;
+        uint64_t prefix = 0;
+        for (size_t j = 0; j < 8; j++) {
+            prefix = (prefix << 8) | (j < keys[i].length ? key[j] : 0);
+        }
+        keys[i].prefix = prefix;
+    }
+    
+    KeyedSort ks = {list, keys, kb.data};
+    qsort_r(list->order, list->count, sizeof(int), compare_key, &ks);
+    
+    free(keys);
+    free(kb.data);
 }
 
 // 比较函数：按时间
-static int compare_time(const void *a, const void *b) {
-    const FileEntry *fa = (const FileEntry *)a;
-    const FileEntry *fb = (const FileEntry *)b;
-    if (fa->info.st_mtime < fb->info.st_mtime) return 1;
-    if (fa->info.st_mtime > fb->info.st_mtime) return -1;
+static int compare_time(const void *a, const void *b, void *arg) {
+    const FileList *list = arg;
+    time_t ta = list->meta[*(const int *)a].mtime;
+    time_t tb = list->meta[*(const int *)b].mtime;
+    if (ta < tb) return 1;
+    if (ta > tb) return -1;
     return 0;
 }
 
-// 排序文件
-static void sort_files(FileEntry *files, int count, Options *opts) {
+// 排序文件（只排序下标数组）
+static void sort_files(FileList *list, Options *opts) {
+    if (opts->unsorted) return;
+    
     if (opts->sort_by_time) {
-        qsort(files, count, sizeof(FileEntry), compare_time);
+        qsort_r(list->order, list->count, sizeof(int), compare_time, list);
     } else {
-        qsort(files, count, sizeof(FileEntry), compare_name);
+        sort_by_name(list, opts);
     }
     
     if (opts->reverse_sort) {
-        for (int i = 0; i < count / 2; i++) {
-            FileEntry temp = files[i];
-            files[i] = files[count - i - 1];
-            files[count - i - 1] = temp;
+        for (int i = 0; i < list->count / 2; i++) {
+            int temp = list->order[i];
+            list->order[i] = list->order[list->count - i - 1];
+            list->order[list->count - i - 1] = temp;
         }
     }
 }
 
+// uid/gid -> 名称缓存（开放寻址），整个运行期间共享，-R 也只查询一次
+typedef struct {
+    unsigned int id;
+    char *name;
+    int used;
+} IdNameSlot;
+
+typedef struct {
+    IdNameSlot *slots;
+    size_t capacity;        // 2 的幂
+    size_t count;
+} IdNameCache;
+
+static IdNameCache user_cache;
+static IdNameCache group_cache;
+
+static size_t id_slot_index(unsigned int id, size_t capacity) {
+    return (id * 2654435761u) & (capacity - 1);
+}
+
+// 插入新名称，负载超过一半时扩容；扩容失败且已无空位时返回 0，名称不被缓存
+static int id_cache_insert(IdNameCache *cache, unsigned int id, char *name) {
+    if ((cache->count + 1) * 2 > cache->capacity) {
+        size_t new_capacity = cache->capacity ? cache->capacity * 2 : 64;
+        IdNameSlot *slots = calloc(new_capacity, sizeof(IdNameSlot));
+        if (slots != NULL) {
+            for (size_t i = 0; i < cache->capacity; i++) {
+                if (!cache->slots[i].used) continue;
+                size_t j = id_slot_index(cache->slots[i].id, new_capacity);
+                while (slots[j].used) j = (j + 1) & (new_capacity - 1);
+                slots[j] = cache->slots[i];
+            }
+            free(cache->slots);
+            cache->slots = slots;
+            cache->capacity = new_capacity;
+        } else if (cache->count + 1 >= cache->capacity) {
+            // 扩容失败时只要旧表插入后仍留有空位（保证查找能终止）就继续用旧表
+            return 0;
+        }
+    }
+    
+    size_t i = id_slot_index(id, cache->capacity);
+    while (cache->slots[i].used) i = (i + 1) & (cache->capacity - 1);
+    cache->slots[i].id = id;
+    cache->slots[i].name = name;
+    cache->slots[i].used = 1;
+    cache->count++;
+    return 1;
+}
+
+static const char* id_cache_find(IdNameCache *cache, unsigned int id) {
+    if (cache->capacity == 0) return NULL;
+    size_t i = id_slot_index(id, cache->capacity);
+    while (cache->slots[i].used) {
+        if (cache->slots[i].id == id) return cache->slots[i].name;
+        i = (i + 1) & (cache->capacity - 1);
+    }
+    return NULL;
+}
+
+// 查询用户名，未知 uid 显示数字
+static const char* lookup_user_name(uid_t uid) {
+    const char *cached = id_cache_find(&user_cache, uid);
+    if (cached) return cached;
+    
+    struct passwd *pw = getpwuid(uid);
+    char buffer[32];
+    if (pw == NULL) snprintf(buffer, sizeof(buffer), "%u", (unsigned int)uid);
+    char *name = strdup(pw ? pw->pw_name : buffer);
+    if (name == NULL) return "?";
+    
+    if (!id_cache_insert(&user_cache, uid, name)) {
+        // 缓存不可用时退回不缓存的查询，结果只保留到下一次调用
+        static char uncached[256];
+        snprintf(uncached, sizeof(uncached), "%s", name);
+        free(name);
+        return uncached;
+    }
+    return name;
+}
+
+// 查询组名，未知 gid 显示数字
+static const char* lookup_group_name(gid_t gid) {
+    const char *cached = id_cache_find(&group_cache, gid);
+    if (cached) return cached;
+    
+    struct group *gr = getgrgid(gid);
+    char buffer[32];
+    if (gr == NULL) snprintf(buffer, sizeof(buffer), "%u", (unsigned int)gid);
+    char *name = strdup(gr ? gr->gr_name : buffer);
+    if (name == NULL) return "?";
+    
+    if (!id_cache_insert(&group_cache, gid, name)) {
+        // 缓存不可用时退回不缓存的查询，结果只保留到下一次调用
+        static char uncached[256];
+        snprintf(uncached, sizeof(uncached), "%s", name);
+        free(name);
+        return uncached;
+    }
+    return name;
+}
+
 // 获取权限字符串
 static void get_permission_string(mode_t mode, char *perm) {
     perm[0] = S_ISDIR(mode) ? 'd' : 
@@ -373,67 +1295,111 @@ static void get_permission_string(mode_t mode, char *perm) {
 }
 
 // 打印长格式（带图标）
-static void print_long_format(FileEntry *files, int count, Options *opts) {
-    // 计算总块数
+// 长格式列宽
+typedef struct {
+    int user;
+    int group;
+} LongWidths;
+
+// 按列表内容放宽列宽（名称来自缓存，不会重复查询）
+static void measure_long_widths(FileList *list, LongWidths *widths) {
+    for (int i = 0; i < list->count; i++) {
+        int len = strlen(lookup_user_name(list->meta[i].uid));
+        if (len > widths->user) widths->user = len;
+        len = strlen(lookup_group_name(list->meta[i].gid));
+        if (len > widths->group) widths->group = len;
+    }
+}
+
+// 计算总块数
+static long count_blocks(FileList *list) {
     long total_blocks = 0;
-    for (int i = 0; i < count; i++) {
-        total_blocks += files[i].info.st_blocks;
+    for (int i = 0; i < list->count; i++) {
+        total_blocks += list->meta[i].blocks;
     }
-    
-    if (count > 0) {
-        color_print(COLOR_BRIGHT_BLUE, "总计 %ld", total_blocks / 2);
+    return total_blocks;
+}
+
+static void print_long_rows(FileList *list, Options *opts, const LongWidths *widths);
+
+static void print_long_format(FileList *list, Options *opts) {
+    if (list->count > 0) {
+        color_print(COLOR_BRIGHT_BLUE, "总计 %ld", count_blocks(list) / 2);
         printf("\n");
     }
     
-    for (int i = 0; i < count; i++) {
-        FileEntry *fe = &files[i];
+    LongWidths widths = {1, 1};
+    measure_long_widths(list, &widths);
+    print_long_rows(list, opts, &widths);
+}
+
+// 按给定列宽打印长格式的每一行
+static void print_long_rows(FileList *list, Options *opts, const LongWidths *widths) {
+    int count = list->count;
+    
+    for (int k = 0; k < count; k++) {
+        int i = list->order[k];
+        const FileMeta *fm = &list->meta[i];
+        const char *name = file_name(list, i);
         
         // inode号
         if (opts->show_inode) {
-            printf("%8lu ", (unsigned long)fe->info.st_ino);
+            printf("%8lu ", (unsigned long)fm->ino);
         }
         
         // 权限
         char perm[11];
-        get_permission_string(fe->info.st_mode, perm);
+        get_permission_string(fm->mode, perm);
         printf("%s ", perm);
         
         // 链接数
-        printf("%3ld ", (long)fe->info.st_nlink);
+        printf("%3ld ", (long)fm->nlink);
         
         // 用户和组
-        struct passwd *pw = getpwuid(fe->info.st_uid);
-        struct group *gr = getgrgid(fe->info.st_gid);
-        printf("%-8s %-8s ", pw ? pw->pw_name : "?", gr ? gr->gr_name : "?");
+        printf("%-*s %-*s ", widths->user, lookup_user_name(fm->uid),
+               widths->group, lookup_group_name(fm->gid));
         
         // 大小
         if (opts->human_size) {
-            char *size_str = format_size(fe->info.st_size);
+            char *size_str = format_size(fm->size);
             printf("%8s ", size_str);
         } else {
-            printf("%8ld ", (long)fe->info.st_size);
+            printf("%8ld ", (long)fm->size);
         }
         
         // 时间
-        char *time_str = format_time(fe->info.st_mtime);
+        char *time_str = format_time(fm->mtime);
         printf("%s ", time_str);
         
+        // git 状态
+        if (opts->show_git) {
+            char status = fm->git_status ? fm->git_status : ' ';
+            const char *color = status == 'M' ? COLOR_BRIGHT_YELLOW :
+                                status == '?' ? COLOR_BRIGHT_RED :
+                                status == 'U' ? COLOR_BRIGHT_MAGENTA : NULL;
+            if (opts->color && color) {
+                printf("%s%c%s ", color, status, COLOR_RESET);
+            } else {
+                printf("%c ", status);
+            }
+        }
+        
         // 图标（如果启用）
         if (opts->show_icons) {
-            printf("%s", get_file_icon(fe->info.st_mode, fe->name));
+            printf("%s", get_file_icon(fm->mode, name));
         }
         
         // 文件名（带颜色）
-        const char *color = opts->color ? get_file_color(fe->info.st_mode) : NULL;
+        const char *color = opts->color ? get_file_color(fm->mode) : NULL;
         if (color) {
-            color_print(color, "%s", fe->name);
+            color_print(color, "%s", name);
         } else {
-            printf("%s", fe->name);
+            printf("%s", name);
         }
         
         // 类型标识符
-        if (opts->classify && fe->type_indicator != ' ') {
-            printf("%c", fe->type_indicator);
+        if (opts->classify && fm->type_indicator != ' ') {
+            printf("%c", fm->type_indicator);
         }
         
         printf("\n");
@@ -441,7 +1407,9 @@ static void print_long_format(FileEntry *files, int count, Options *opts) {
 }
 
 // 打印网格格式（带图标）
-static void print_grid_format(FileEntry *files, int count, Options *opts) {
+static void print_grid_format(FileList *list, Options *opts) {
+    int count = list->count;
+    
     // 获取终端宽度
     struct winsize w;
     int term_width = 80; // 默认值
@@ -452,9 +1420,9 @@ static void print_grid_format(FileEntry *files, int count, Options *opts) {
     // 计算最大显示长度（包括图标）
     int max_len = 0;
     for (int i = 0; i < count; i++) {
-        int len = strlen(files[i].name);
+        int len = strlen(file_name(list, i));
         if (opts->show_icons) len += 3; // 图标占3个字符宽度
-        if (opts->classify && files[i].type_indicator != ' ') len += 1;
+        if (opts->classify && list->meta[i].type_indicator != ' ') len += 1;
         if (len > max_len) max_len = len;
     }
     
@@ -471,30 +1439,32 @@ static void print_grid_format(FileEntry *files, int count, Options *opts) {
             int idx = row + col * rows;
             if (idx >= count) continue;
             
-            FileEntry *fe = &files[idx];
+            int i = list->order[idx];
+            const FileMeta *fm = &list->meta[i];
+            const char *name = file_name(list, i);
             
             // 图标（如果启用）
             if (opts->show_icons) {
-                printf("%s", get_file_icon(fe->info.st_mode, fe->name));
+                printf("%s", get_file_icon(fm->mode, name));
             }
             
             // 颜色
-            const char *color = opts->color ? get_file_color(fe->info.st_mode) : NULL;
+            const char *color = opts->color ? get_file_color(fm->mode) : NULL;
             if (color) {
-                color_print(color, "%s", fe->name);
+                color_print(color, "%s", name);
             } else {
-                printf("%s", fe->name);
+                printf("%s", name);
             }
             
             // 类型标识符
-            if (opts->classify && fe->type_indicator != ' ') {
-                printf("%c", fe->type_indicator);
+            if (opts->classify && fm->type_indicator != ' ') {
+                printf("%c", fm->type_indicator);
             }
             
             // 填充空格
-            int name_len = strlen(fe->name);
+            int name_len = strlen(name);
             if (opts->show_icons) name_len += 3; // 图标宽度
-            if (opts->classify && fe->type_indicator != ' ') name_len += 1;
+            if (opts->classify && fm->type_indicator != ' ') name_len += 1;
             
             for (int j = name_len; j < max_len; j++) {
                 printf(" ");
@@ -504,67 +1474,493 @@ static void print_grid_format(FileEntry *files, int count, Options *opts) {
     }
 }
 
+// -U：不排序，按读取顺序分批输出，内存占用与目录大小无关
+// 长格式的列宽只增不减，在已输出的窗口上滑动累积
+static int stream_directory(const char *path, Options *opts) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        print_error("无法打开目录 '%s': %s", path, strerror(errno));
+        return 0;
+    }
+    
+    FileList window;
+    file_list_init(&window);
+    LongWidths widths = {1, 1};
+    int level = required_stat_level(opts);
+    int long_format = opts->long_format || opts->one_per_line;
+    long total_blocks = 0;
+    long total = 0;
+    int out_of_memory = 0;
+    
+    while (1) {
+        struct dirent *entry = readdir(dir);
+        
+        if (entry != NULL) {
+            if (!opts->show_all && entry->d_name[0] == '.') {
+                continue;
+            }
+            mode_t type = entry->d_type != DT_UNKNOWN ? DTTOIF(entry->d_type) : 0;
+            if (!file_list_add(&window, entry->d_name, type)) {
+                // 当作读完处理：先输出窗口中已读到的条目再报错
+                out_of_memory = 1;
+                entry = NULL;
+            }
+        }
+        
+        // 窗口满或读完时输出这一批
+        if (window.count >= STREAM_WINDOW || (entry == NULL && window.count > 0)) {
+            stat_files(&window, dirfd(dir), level);
+            if (opts->show_git) {
+                git_annotate(&window, path);
+            }
+            if (long_format) {
+                measure_long_widths(&window, &widths);
+                print_long_rows(&window, opts, &widths);
+                total_blocks += count_blocks(&window);
+            } else {
+                print_grid_format(&window, opts);
+            }
+            total += window.count;
+            file_list_reset(&window);
+            fflush(stdout);
+        }
+        
+        if (entry == NULL) break;
+    }
+    
+    closedir(dir);
+    file_list_free(&window);
+    if (out_of_memory) {
+        print_error("内存分配失败");
+    }
+    
+    // 总计只能在读完后给出
+    if (long_format && total > 0) {
+        color_print(COLOR_BRIGHT_BLUE, "总计 %ld", total_blocks / 2);
+        printf("\n");
+    }
+    
+    return total > 0;
+}
+
 // 列出单个目录
 static int list_directory(const char *path, Options *opts) {
-    FileEntry *files;
-    int count = collect_files(path, opts, &files);
+    if (opts->unsorted) {
+        return stream_directory(path, opts);
+    }
+    
+    FileList list;
+    file_list_init(&list);
+    int count = collect_files(path, opts, &list);
     if (count == 0) {
         // 可能是空目录或出错
-        free(files);
+        file_list_free(&list);
         return 0;
     }
     
     // 排序
-    sort_files(files, count, opts);
+    sort_files(&list, opts);
     
     // 打印
     if (opts->long_format || opts->one_per_line) {
-        print_long_format(files, count, opts);
+        print_long_format(&list, opts);
     } else {
-        print_grid_format(files, count, opts);
+        print_grid_format(&list, opts);
     }
     
-    free(files);
+    file_list_free(&list);
     return 1;
 }
 
-// 递归列出目录（带图标）
-static void list_recursive(const char *path, Options *opts, int depth) {
-    // 首先列出当前目录
-    FileEntry *files;
-    int count = collect_files(path, opts, &files);
-    if (count == 0) {
-        free(files);
+// ========== -R 预读 ==========
+
+// 一个待输出的目录：线程池提前读取、stat 并排序，主线程按原来的深度优先顺序取用
+typedef struct {
+    char *path;
+    Options *opts;
+    FileList list;
+    int count;
+    int error;          // 读取失败时的 errno，输出时再报告
+    int submitted;      // 已交给线程池
+    int done;
+} DirJob;
+
+static WorkPool *prefetch_pool = NULL;
+static pthread_mutex_t prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefetch_done = PTHREAD_COND_INITIALIZER;
+
+static void load_directory(void *arg) {
+    DirJob *job = arg;
+    job->count = read_entries(job->path, job->opts, &job->list, &job->error);
+    sort_files(&job->list, job->opts);
+    
+    pthread_mutex_lock(&prefetch_lock);
+    job->done = 1;
+    pthread_cond_broadcast(&prefetch_done);
+    pthread_mutex_unlock(&prefetch_lock);
+}
+
+// 交给线程池提前读取（线程池不可用时等到输出前再同步读取）
+static void dir_job_prefetch(DirJob *job) {
+    if (job->submitted || prefetch_pool == NULL) return;
+    if (workpool_submit(prefetch_pool, load_directory, job)) {
+        job->submitted = 1;
+    }
+}
+
+// 等待目录读取完成
+static void dir_job_wait(DirJob *job) {
+    if (!job->submitted) {
+        load_directory(job);
+        return;
+    }
+    
+    pthread_mutex_lock(&prefetch_lock);
+    while (!job->done) {
+        pthread_cond_wait(&prefetch_done, &prefetch_lock);
+    }
+    pthread_mutex_unlock(&prefetch_lock);
+}
+
+static void dir_job_free(DirJob *job) {
+    file_list_free(&job->list);
+    free(job->path);
+}
+
+// 输出一个目录，再依次递归子目录；输出当前目录前先预读接下来的子目录
+static void list_recursive_job(DirJob *job, int depth) {
+    dir_job_wait(job);
+    if (job->count == 0) {
+        report_read_error(job->path, job->error);
         return;
     }
     
-    sort_files(files, count, opts);
+    FileList *list = &job->list;
+    Options *opts = job->opts;
+    
+    // 子目录按输出顺序排列（超过 --depth 时不再深入）
+    int child_count = 0;
+    int descend = opts->max_depth < 0 || depth < opts->max_depth;
+    DirJob *children = descend ? malloc(sizeof(DirJob) * list->count) : NULL;
+    for (int k = 0; children && k < list->count; k++) {
+        int i = list->order[k];
+        const char *name = file_name(list, i);
+        if (S_ISDIR(list->meta[i].mode) && 
+            strcmp(name, ".") != 0 && 
+            strcmp(name, "..") != 0) {
+            
+            DirJob *child = &children[child_count];
+            memset(child, 0, sizeof(*child));
+            child->opts = opts;
+            child->path = malloc(strlen(job->path) + strlen(name) + 2);
+            if (child->path == NULL) continue;
+            sprintf(child->path, "%s/%s", job->path, name);
+            file_list_init(&child->list);
+            child_count++;
+        }
+    }
+    
+    for (int c = 0; c < child_count && c < PREFETCH_AHEAD; c++) {
+        dir_job_prefetch(&children[c]);
+    }
     
     // 缩进和目录名
     for (int i = 0; i < depth; i++) printf("  ");
-    color_println(COLOR_BRIGHT_BLUE, "%s:", path);
+    color_println(COLOR_BRIGHT_BLUE, "%s:", job->path);
     
     if (opts->long_format || opts->one_per_line) {
-        print_long_format(files, count, opts);
+        print_long_format(list, opts);
     } else {
-        print_grid_format(files, count, opts);
+        print_grid_format(list, opts);
     }
     
     printf("\n");
     
-    // 递归处理子目录
-    for (int i = 0; i < count; i++) {
-        if (S_ISDIR(files[i].info.st_mode) && 
-            strcmp(files[i].name, ".") != 0 && 
-            strcmp(files[i].name, "..") != 0) {
-            
-            char sub_path[1024];
-            snprintf(sub_path, sizeof(sub_path), "%s/%s", path, files[i].name);
-            list_recursive(sub_path, opts, depth + 1);
+    // 递归处理子目录，预读窗口随之后移
+    for (int c = 0; c < child_count; c++) {
+        if (c + PREFETCH_AHEAD < child_count) {
+            dir_job_prefetch(&children[c + PREFETCH_AHEAD]);
+        }
+        list_recursive_job(&children[c], depth + 1);
+        dir_job_free(&children[c]);
+    }
+    
+    free(children);
+}
+
+// 预读线程里也会调用 stat_files，先建好共用的 stat 线程池
+static void start_prefetch_pools(void) {
+    if (stat_pool == NULL) {
+        stat_pool = workpool_create(0, 0);
+    }
+    if (prefetch_pool == NULL) {
+        int threads = workpool_cpu_count();
+        prefetch_pool = workpool_create(threads > PREFETCH_THREADS ? threads : PREFETCH_THREADS, 0);
+    }
+}
+
+// 递归列出目录（带图标）
+static void list_recursive(const char *path, Options *opts) {
+    start_prefetch_pools();
+    
+    DirJob root;
+    memset(&root, 0, sizeof(root));
+    root.path = strdup(path);
+    root.opts = opts;
+    file_list_init(&root.list);
+    if (root.path != NULL) {
+        list_recursive_job(&root, 0);
+    }
+    dir_job_free(&root);
+}
+
+// ========== --tree 树形视图 ==========
+
+// 树中的一个目录
+// 各目录由线程池并行读取，全部完成后自底向上汇总，不再二次遍历文件系统
+typedef struct TreeNode {
+    char *path;
+    int depth;
+    Options *opts;
+    FileList list;              // 只有需要显示的层级才保留
+    int *child_of;              // 条目下标 -> 子目录下标（非子目录为 -1）
+    struct TreeNode *children;
+    int child_count;
+    int error;
+    long long size;             // 直接包含的文件大小，汇总后为整个子树
+    long files;                 // 文件数，同上
+    long dirs;                  // 子树中的目录数（不含自身）
+} TreeNode;
+
+static int is_dot_entry(const char *name) {
+    return strcmp(name, ".") == 0 || strcmp(name, "..") == 0;
+}
+
+static void tree_node_init(TreeNode *node, char *path, int depth, Options *opts) {
+    memset(node, 0, sizeof(*node));
+    node->path = path;
+    node->depth = depth;
+    node->opts = opts;
+    file_list_init(&node->list);
+}
+
+// 读取一个目录，统计其中的文件，再把子目录交给线程池
+static void tree_load(void *arg) {
+    TreeNode *node = arg;
+    Options *opts = node->opts;
+    FileList *list = &node->list;
+    
+    read_entries(node->path, opts, list, &node->error);
+    
+    int shown = opts->max_depth < 0 || node->depth < opts->max_depth;
+    int dir_count = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (S_ISDIR(list->meta[i].mode) && !is_dot_entry(file_name(list, i))) dir_count++;
+    }
+    
+    node->children = calloc(dir_count > 0 ? dir_count : 1, sizeof(TreeNode));
+    if (shown) {
+        node->child_of = malloc(sizeof(int) * (list->count > 0 ? list->count : 1));
+    }
+    
+    for (int i = 0; i < list->count; i++) {
+        const char *name = file_name(list, i);
+        FileMeta *fm = &list->meta[i];
+        if (node->child_of) node->child_of[i] = -1;
+        if (is_dot_entry(name)) continue;
+        
+        if (!S_ISDIR(fm->mode)) {
+            node->size += fm->size;
+            node->files++;
+            continue;
+        }
+        
+        char *child_path = malloc(strlen(node->path) + strlen(name) + 2);
+        if (node->children == NULL || child_path == NULL) {
+            free(child_path);
+            continue;
+        }
+        sprintf(child_path, "%s/%s", node->path, name);
+        tree_node_init(&node->children[node->child_count], child_path, node->depth + 1, opts);
+        if (node->child_of) node->child_of[i] = node->child_count;
+        node->child_count++;
+    }
+    
+    // 不显示的层级只需要合计
+    if (!shown) {
+        file_list_free(list);
+        file_list_init(list);
+    }
+    
+    for (int c = 0; c < node->child_count; c++) {
+        if (!workpool_submit(prefetch_pool, tree_load, &node->children[c])) {
+            tree_load(&node->children[c]);
+        }
+    }
+}
+
+// 自底向上汇总子树
+static void tree_sum(TreeNode *node) {
+    for (int c = 0; c < node->child_count; c++) {
+        TreeNode *child = &node->children[c];
+        tree_sum(child);
+        node->size += child->size;
+        node->files += child->files;
+        node->dirs += child->dirs + 1;
+    }
+}
+
+static void tree_free(TreeNode *node) {
+    for (int c = 0; c < node->child_count; c++) {
+        tree_free(&node->children[c]);
+    }
+    free(node->children);
+    free(node->child_of);
+    file_list_free(&node->list);
+    free(node->path);
+}
+
+// 条目大小：文件取自身大小，目录取子树合计
+static long long tree_entry_size(const TreeNode *node, int i) {
+    int c = node->child_of ? node->child_of[i] : -1;
+    return c >= 0 ? node->children[c].size : (long long)node->list.meta[i].size;
+}
+
+// 比较函数：按大小从大到小，相同时按名称
+static int compare_tree_size(const void *a, const void *b, void *arg) {
+    const TreeNode *node = arg;
+    int ia = *(const int *)a;
+    int ib = *(const int *)b;
+    long long sa = tree_entry_size(node, ia);
+    long long sb = tree_entry_size(node, ib);
+    if (sa != sb) return sa < sb ? 1 : -1;
+    return strcasecmp(file_name(&node->list, ia), file_name(&node->list, ib));
+}
+
+static void tree_print_size(long long bytes, Options *opts) {
+    if (opts->human_size) {
+        printf("%s", format_size(bytes));
+    } else {
+        printf("%lld", bytes);
+    }
+}
+
+// 输出目录下的各项，prefix 是上层留下的竖线
+static void tree_print_children(TreeNode *node, Options *opts, char *prefix, size_t prefix_len) {
+    FileList *list = &node->list;
+    
+    if (opts->tree_top > 0) {
+        qsort_r(list->order, list->count, sizeof(int), compare_tree_size, node);
+    } else {
+        sort_files(list, opts);
+    }
+    
+    int visible = 0;
+    for (int k = 0; k < list->count; k++) {
+        if (!is_dot_entry(file_name(list, list->order[k]))) visible++;
+    }
+    int shown = opts->tree_top > 0 && opts->tree_top < visible ? opts->tree_top : visible;
+    
+    int printed = 0;
+    long long rest_size = 0;
+    for (int k = 0; k < list->count; k++) {
+        int i = list->order[k];
+        const char *name = file_name(list, i);
+        FileMeta *fm = &list->meta[i];
+        if (is_dot_entry(name)) continue;
+        
+        if (printed >= shown) {
+            rest_size += tree_entry_size(node, i);
+            continue;
+        }
+        printed++;
+        
+        int last = printed == shown && shown == visible;
+        printf("%s%s", prefix, last ? "└── " : "├── ");
+        
+        if (opts->show_icons) {
+            printf("%s", get_file_icon(fm->mode, name));
+        }
+        const char *color = opts->color ? get_file_color(fm->mode) : NULL;
+        if (color) {
+            color_print(color, "%s", name);
+        } else {
+            printf("%s", name);
+        }
+        if (opts->classify && fm->type_indicator != ' ') {
+            printf("%c", fm->type_indicator);
+        }
+        
+        int c = node->child_of ? node->child_of[i] : -1;
+        TreeNode *child = c >= 0 ? &node->children[c] : NULL;
+        
+        printf("  ");
+        tree_print_size(tree_entry_size(node, i), opts);
+        if (child) {
+            printf(" (%ld 个文件)", child->files);
+            if (child->error) {
+                printf(" [无法打开: %s]", strerror(child->error));
+            }
+        }
+        printf("\n");
+        
+        // 子目录在 --depth 内时继续展开
+        const char *branch = last ? "    " : "│   ";
+        size_t branch_len = strlen(branch);
+        if (child && child->list.count > 0 && prefix_len + branch_len < PATH_MAX) {
+            memcpy(prefix + prefix_len, branch, branch_len + 1);
+            tree_print_children(child, opts, prefix, prefix_len + branch_len);
+            prefix[prefix_len] = '\0';
         }
     }
     
-    free(files);
+    if (shown < visible) {
+        printf("%s└── … 其余 %d 项，共 ", prefix, visible - shown);
+        tree_print_size(rest_size, opts);
+        printf("\n");
+    }
+}
+
+// 树形列出目录
+static void list_tree(const char *path, Options *opts) {
+    start_prefetch_pools();
+    
+    TreeNode root;
+    tree_node_init(&root, strdup(path), 0, opts);
+    if (root.path == NULL) {
+        print_error("内存分配失败");
+        return;
+    }
+    
+    if (prefetch_pool == NULL || !workpool_submit(prefetch_pool, tree_load, &root)) {
+        tree_load(&root);
+    }
+    workpool_wait(prefetch_pool);
+    tree_sum(&root);
+    
+    if (root.error) {
+        report_read_error(path, root.error);
+        tree_free(&root);
+        return;
+    }
+    
+    if (opts->color) {
+        color_print(COLOR_BRIGHT_BLUE, "%s", path);
+    } else {
+        printf("%s", path);
+    }
+    printf("  ");
+    tree_print_size(root.size, opts);
+    printf("\n");
+    
+    char prefix[PATH_MAX + 16] = "";
+    tree_print_children(&root, opts, prefix, 0);
+    
+    printf("\n%ld 个目录，%ld 个文件，共 ", root.dirs, root.files);
+    tree_print_size(root.size, opts);
+    printf("\n");
+    
+    tree_free(&root);
 }
 
 // tkls主函数
@@ -583,6 +1979,10 @@ int tkls_main(int argc, char **argv) {
     
     int exit_code = 0;
     
+    if (opts.locale_sort) {
+        setlocale(LC_COLLATE, "");
+    }
+    
     for (int i = 0; i < path_count; i++) {
         const char *path = paths[i];
         
@@ -600,8 +2000,10 @@ int tkls_main(int argc, char **argv) {
                 color_println(COLOR_BRIGHT_BLUE, "%s:", path);
             }
             
-            if (opts.recursive) {
-                list_recursive(path, &opts, 0);
+            if (opts.tree_view) {
+                list_tree(path, &opts);
+            } else if (opts.recursive) {
+                list_recursive(path, &opts);
             } else {
                 if (!list_directory(path, &opts)) {
                     // 可能是空目录或出错
@@ -619,40 +2021,44 @@ int tkls_main(int argc, char **argv) {
                 continue;
             }
             
-            // 创建一个FileEntry结构
-            FileEntry file;
+            // 创建只含一个条目的列表
             const char *basename = strrchr(path, '/');
-            if (basename) {
-                strncpy(file.name, basename + 1, sizeof(file.name) - 1);
-            } else {
-                strncpy(file.name, path, sizeof(file.name) - 1);
-            }
-            file.name[sizeof(file.name) - 1] = '\0';
-            file.info = st;
-            file.is_hidden = (path[0] == '.');
-            file.type_indicator = get_type_indicator(st.st_mode);
-            
-            FileEntry *files = &file;
+            basename = basename ? basename + 1 : path;
             
             if (opts.long_format || opts.one_per_line) {
-                print_long_format(files, 1, &opts);
+                FileList list;
+                file_list_init(&list);
+                if (file_list_add(&list, basename, st.st_mode & S_IFMT)) {
+                    file_meta_set_stat(&list.meta[0], &st);
+                    print_long_format(&list, &opts);
+                }
+                file_list_free(&list);
             } else {
                 // 图标
                 if (opts.show_icons) {
-                    printf("%s", get_file_icon(st.st_mode, file.name));
+                    printf("%s", get_file_icon(st.st_mode, basename));
                 }
                 
                 // 颜色
                 const char *color = opts.color ? get_file_color(st.st_mode) : NULL;
                 if (color) {
-                    color_println(color, "%s", file.name);
+                    color_println(color, "%s", basename);
                 } else {
-                    printf("%s\n", file.name);
+                    printf("%s\n", basename);
                 }
             }
         }
     }
     
+    if (prefetch_pool) {
+        workpool_destroy(prefetch_pool);
+        prefetch_pool = NULL;
+    }
+    if (stat_pool) {
+        workpool_destroy(stat_pool);
+        stat_pool = NULL;
+    }
+    git_free_repos();
     if (paths) free(paths);
     return exit_code;
-}
\ No newline at end of file
+}
@@ -10,11 +10,17 @@
 #include "../common/colors.h"
 #include "../common/utils.h"
 #include "../common/progress.h"
+#include "../common/hash.h"
+#include "../common/workpool.h"
 
 #define BUFFER_SIZE 8192
 #define MAX_LINE 4096
 #define MAX_FILTERS 20
 #define MAX_COLUMNS 100
+#define SORT_MEMORY_MB 256          // sort 默认内存上限（MB），超出后分批写入临时文件
+#define SORT_SLICE_MIN 16384        // 并行排序时每个片段至少的行数
+#define SORT_MAX_MERGE 128          // 一次最多同时归并的临时文件数
+#define SORT_IO_BUFFER (64 * 1024)  // 临时文件的读写缓冲区
 
 typedef enum {
     FILTER_NONE,
@@ -85,7 +91,8 @@ void print_help() {
     printf("  grep -v <模式>       不包含模式的行\n");
     printf("  sed 's/old/new/'     替换文本\n");
     printf("  cut -f N             提取第N列\n");
-    printf("  sort [-n] [-r]       排序（-n数字排序，-r反向）\n");
+    printf("  sort [-n] [-r] [-i]  排序（-n数字排序，-r反向，-i忽略大小写，相同的键保持原顺序）\n");
+    printf("       [-k N] [-S MB]  -k按第N列排序，-S内存上限（默认256MB，超出时借助临时文件）\n");
     printf("  uniq [-c]            去重（-c计数）\n");
     printf("  wc                   统计行数/词数/字符数\n");
     printf("  head -n N            前N行\n");
@@ -97,7 +104,7 @@ void print_help() {
     printf("  reverse              反转行\n");
     printf("  join -d ','          用分隔符连接字段\n");
     printf("  split -d ','         用分隔符分割字段\n");
-    printf("  count                统计出现次数\n\n");
+    printf("  count                统计每行出现次数，按次数从多到少输出\n\n");
     
     printf("示例:\n");
     printf("  cat log.txt | tkstream grep 'error' | head -n 10\n");
@@ -178,6 +185,10 @@ int parse_filter(int argc, char *argv[], int *index, Filter *filter) {
                 filter->reverse = 1;
             } else if (strcmp(argv[*index], "-i") == 0) {
                 filter->ignore_case = 1;
+            } else if (strcmp(argv[*index], "-k") == 0 && *index + 1 < argc) {
+                filter->field = atoi(argv[++(*index)]);
+            } else if (strcmp(argv[*index], "-S") == 0 && *index + 1 < argc) {
+                filter->end = atoi(argv[++(*index)]);  // 使用end作为内存上限（MB）
             }
             (*index)++;
         }
@@ -428,17 +439,551 @@ void apply_split(const char *line, const char *delimiter, char ***parts, int *co
     }
 }
 
-// 比较函数用于排序
-int compare_strings(const void *a, const void *b) {
-    return strcmp(*(const char **)a, *(const char **)b);
+// ========== uniq / count 计数表 ==========
+
+// 计数表中的一行
+typedef struct {
+    uint64_t hash;
+    size_t offset;      // 行内容在 arena 中的位置（以 '\0' 结尾）
+    int length;
+    int count;
+} CountEntry;
+
+// 按行内容计数的哈希表（开放寻址），行内容统一存放在 arena 中
+typedef struct {
+    int *slots;             // entries 下标 + 1，0 表示空槽
+    size_t capacity;
+    CountEntry *entries;    // 按首次出现的顺序排列
+    int count;
+    int entry_capacity;
+    char *arena;
+    size_t arena_used;
+    size_t arena_capacity;
+} LineCounter;
+
+void line_counter_init(LineCounter *counter) {
+    memset(counter, 0, sizeof(*counter));
 }
 
-int compare_strings_numeric(const void *a, const void *b) {
-    double num_a = atof(*(const char **)a);
-    double num_b = atof(*(const char **)b);
-    if (num_a < num_b) return -1;
-    if (num_a > num_b) return 1;
-    return 0;
+void line_counter_free(LineCounter *counter) {
+    free(counter->slots);
+    free(counter->entries);
+    free(counter->arena);
+    memset(counter, 0, sizeof(*counter));
+}
+
+// 扩容并重新放置所有行
+int line_counter_grow(LineCounter *counter) {
+    size_t new_capacity = counter->capacity ? counter->capacity * 2 : 1024;
+    int *slots = calloc(new_capacity, sizeof(int));
+    if (!slots) return 0;
+    
+    for (int i = 0; i < counter->count; i++) {
+        size_t pos = counter->entries[i].hash & (new_capacity - 1);
+        while (slots[pos]) pos = (pos + 1) & (new_capacity - 1);
+        slots[pos] = i + 1;
+    }
+    
+    free(counter->slots);
+    counter->slots = slots;
+    counter->capacity = new_capacity;
+    return 1;
+}
+
+// 登记一行：已出现过则计数加一，否则复制到 arena；失败返回 0
+int line_counter_add(LineCounter *counter, const char *line, int len) {
+    if ((size_t)(counter->count + 1) * 2 > counter->capacity && !line_counter_grow(counter)) {
+        return 0;
+    }
+    
+    uint64_t hash = hash64(line, len, 0);
+    size_t mask = counter->capacity - 1;
+    size_t pos = hash & mask;
+    
+    while (counter->slots[pos]) {
+        CountEntry *entry = &counter->entries[counter->slots[pos] - 1];
+        if (entry->hash == hash && entry->length == len &&
+            memcmp(counter->arena + entry->offset, line, len) == 0) {
+            entry->count++;
+            return 1;
+        }
+        pos = (pos + 1) & mask;
+    }
+    
+    if (counter->count == counter->entry_capacity) {
+        int new_capacity = counter->entry_capacity ? counter->entry_capacity * 2 : 1024;
+        CountEntry *entries = realloc(counter->entries, new_capacity * sizeof(CountEntry));
+        if (!entries) return 0;
+        counter->entries = entries;
+        counter->entry_capacity = new_capacity;
+    }
+    
+    if (counter->arena_used + len + 1 > counter->arena_capacity) {
+        size_t new_capacity = counter->arena_capacity ? counter->arena_capacity * 2 : 65536;
+        while (new_capacity < counter->arena_used + len + 1) new_capacity *= 2;
+        char *arena = realloc(counter->arena, new_capacity);
+        if (!arena) return 0;
+        counter->arena = arena;
+        counter->arena_capacity = new_capacity;
+    }
+    
+    CountEntry *entry = &counter->entries[counter->count];
+    entry->hash = hash;
+    entry->offset = counter->arena_used;
+    entry->length = len;
+    entry->count = 1;
+    memcpy(counter->arena + counter->arena_used, line, len);
+    counter->arena[counter->arena_used + len] = '\0';
+    counter->arena_used += len + 1;
+    counter->slots[pos] = ++counter->count;
+    return 1;
+}
+
+// 生成一行输出，计数模式下在行首加上次数
+char *format_counted_line(const CountEntry *entry, const char *arena, int with_count) {
+    const char *text = arena + entry->offset;
+    if (!with_count) return strdup(text);
+    
+    size_t size = entry->length + 16;
+    char *line = malloc(size);
+    if (line) snprintf(line, size, "%d %s", entry->count, text);
+    return line;
+}
+
+// 把计数表转换为输出行：uniq 按首次出现的顺序，uniq -c 在行首加次数，
+// count 按次数从多到少（次数相同的保持首次出现的顺序）。返回行数组，失败返回 NULL
+char **counter_to_lines(LineCounter *counter, Filter *filter, int *line_count) {
+    int n = counter->count;
+    char **lines = malloc((n > 0 ? n : 1) * sizeof(char *));
+    int *order = malloc((n > 0 ? n : 1) * sizeof(int));
+    if (!lines || !order) {
+        free(lines);
+        free(order);
+        return NULL;
+    }
+    
+    for (int i = 0; i < n; i++) order[i] = i;
+    
+    // 次数之和等于输入行数，按次数做计数排序，整体仍是线性时间
+    if (filter->type == FILTER_COUNT && n > 0) {
+        int max_count = 0;
+        for (int i = 0; i < n; i++) {
+            if (counter->entries[i].count > max_count) max_count = counter->entries[i].count;
+        }
+        
+        int *bucket = calloc(max_count + 2, sizeof(int));
+        if (bucket) {
+            for (int i = 0; i < n; i++) bucket[max_count - counter->entries[i].count + 1]++;
+            for (int c = 1; c <= max_count + 1; c++) bucket[c] += bucket[c - 1];
+            for (int i = 0; i < n; i++) order[bucket[max_count - counter->entries[i].count]++] = i;
+            free(bucket);
+        }
+    }
+    
+    int with_count = filter->type == FILTER_COUNT || filter->numeric;
+    for (int i = 0; i < n; i++) {
+        lines[i] = format_counted_line(&counter->entries[order[i]], counter->arena, with_count);
+    }
+    
+    free(order);
+    *line_count = n;
+    return lines;
+}
+
+// ========== sort：外部归并排序 ==========
+
+// 排序中的一行
+typedef struct {
+    const char *text;
+    int length;
+    int key_start;      // 排序键在行中的位置（-k 时为第 N 列，否则为整行）
+    int key_length;
+    double number;      // -n 时键的数值
+    int seq;            // 在本批中的输入顺序，键相同时保持原顺序
+} SortLine;
+
+// 计算排序键；列的划分与 cut 相同（连续的分隔符算一个）
+void fill_sort_key(SortLine *line, const Filter *filter, const char *delimiter) {
+    line->key_start = 0;
+    line->key_length = line->length;
+    
+    if (filter->field > 0) {
+        const char *text = line->text;
+        int pos = 0;
+        int start = line->length, end = line->length;
+        for (int field = 1; pos < line->length; field++) {
+            while (pos < line->length && strchr(delimiter, text[pos])) pos++;
+            int field_start = pos;
+            while (pos < line->length && !strchr(delimiter, text[pos])) pos++;
+            if (field == filter->field) {
+                start = field_start;
+                end = pos;
+                break;
+            }
+        }
+        line->key_start = start;
+        line->key_length = end - start;
+    }
+    
+    if (filter->numeric) {
+        line->number = atof(line->text + line->key_start);
+    }
+}
+
+int compare_sort_lines(const SortLine *a, const SortLine *b, const Filter *filter) {
+    int result;
+    if (filter->numeric) {
+        result = (a->number > b->number) - (a->number < b->number);
+    } else {
+        int n = a->key_length < b->key_length ? a->key_length : b->key_length;
+        const char *key_a = a->text + a->key_start;
+        const char *key_b = b->text + b->key_start;
+        result = filter->ignore_case ? strncasecmp(key_a, key_b, n) : memcmp(key_a, key_b, n);
+        if (result == 0) result = (a->key_length > b->key_length) - (a->key_length < b->key_length);
+    }
+    return filter->reverse ? -result : result;
+}
+
+// qsort_r 的比较函数：键相同时按输入顺序，保证稳定
+int compare_sort_entries(const void *a, const void *b, void *arg) {
+    const SortLine *line_a = a;
+    const SortLine *line_b = b;
+    int result = compare_sort_lines(line_a, line_b, arg);
+    return result != 0 ? result : line_a->seq - line_b->seq;
+}
+
+// 归并的一个来源：内存中已排好序的片段，或者溢出的临时文件
+typedef struct {
+    SortLine *lines;
+    int count;
+    int pos;
+    FILE *file;
+    char *buffer;       // 从临时文件读入的当前行
+    size_t buffer_size;
+    SortLine current;
+    int done;
+} MergeSource;
+
+// 取来源的下一行
+void merge_source_next(MergeSource *source, const Filter *filter, const char *delimiter) {
+    if (source->file) {
+        ssize_t len = getline(&source->buffer, &source->buffer_size, source->file);
+        if (len < 0) {
+            source->done = 1;
+            return;
+        }
+        if (len > 0 && source->buffer[len - 1] == '\n') source->buffer[--len] = '\0';
+        source->current.text = source->buffer;
+        source->current.length = len;
+        fill_sort_key(&source->current, filter, delimiter);
+    } else if (source->pos < source->count) {
+        source->current = source->lines[source->pos++];
+    } else {
+        source->done = 1;
+    }
+}
+
+// 排序结果的去向：写到文件，或收集成行数组
+typedef struct {
+    FILE *file;
+    char **lines;
+    int count;
+    int capacity;
+    long long limit;        // 最多输出的行数，< 0 不限（后面紧跟 head 时提前结束归并）
+    long long written;
+} SortOutput;
+
+// 输出一行，达到行数上限返回 0
+int sort_output_line(SortOutput *out, const char *text, int length) {
+    if (out->limit >= 0 && out->written >= out->limit) return 0;
+    
+    if (out->file) {
+        fwrite(text, 1, length, out->file);
+        fputc('\n', out->file);
+    } else {
+        if (out->count == out->capacity) {
+            int new_capacity = out->capacity ? out->capacity * 2 : 10000;
+            char **lines = realloc(out->lines, new_capacity * sizeof(char *));
+            if (!lines) return 0;
+            out->lines = lines;
+            out->capacity = new_capacity;
+        }
+        out->lines[out->count++] = strndup(text, length);
+    }
+    out->written++;
+    return 1;
+}
+
+// 败者树比较：a 是否应排在 b 前面。-1 为建树时的哨兵（最小），取完的来源最大；
+// 来源按输入顺序编号，键相同时编号小的在前
+int merge_before(MergeSource *sources, int a, int b, const Filter *filter) {
+    if (a < 0) return 1;
+    if (b < 0) return 0;
+    if (sources[a].done) return 0;
+    if (sources[b].done) return 1;
+    int result = compare_sort_lines(&sources[a].current, &sources[b].current, filter);
+    return result != 0 ? result < 0 : a < b;
+}
+
+// 来源 s 的当前行变化后，从叶子向上重新比赛；tree[0] 为胜者，其余节点保存败者
+void loser_tree_adjust(int *tree, int k, MergeSource *sources, int s, const Filter *filter) {
+    for (int t = (s + k) / 2; t > 0; t /= 2) {
+        if (merge_before(sources, tree[t], s, filter)) {
+            int winner = tree[t];
+            tree[t] = s;
+            s = winner;
+        }
+    }
+    tree[0] = s;
+}
+
+// 用败者树把 k 个有序来源归并到 out，每输出一行只需 log k 次比较
+void merge_sources(MergeSource *sources, int k, const Filter *filter, const char *delimiter,
+                   SortOutput *out) {
+    if (k == 0) return;
+    int *tree = malloc(k * sizeof(int));
+    if (!tree) return;
+    
+    for (int i = 0; i < k; i++) {
+        merge_source_next(&sources[i], filter, delimiter);
+        tree[i] = -1;
+    }
+    for (int i = k - 1; i >= 0; i--) {
+        loser_tree_adjust(tree, k, sources, i, filter);
+    }
+    
+    while (!sources[tree[0]].done) {
+        int winner = tree[0];
+        if (!sort_output_line(out, sources[winner].current.text, sources[winner].current.length)) break;
+        merge_source_next(&sources[winner], filter, delimiter);
+        loser_tree_adjust(tree, k, sources, winner, filter);
+    }
+    
+    free(tree);
+}
+
+// 外部排序器：行先放进内存中的一批，超过内存上限时整批排好序写入临时文件
+typedef struct {
+    const Filter *filter;
+    const char *delimiter;
+    size_t memory_limit;
+    char *arena;            // 按内存上限一次分配，只有用到的页才真正占用内存
+    size_t arena_used;
+    SortLine *lines;
+    int count;
+    int capacity;
+    FILE **runs;            // 已写入临时文件的有序批次，按输入顺序
+    int run_count;
+    int run_capacity;
+    WorkPool *pool;
+} Sorter;
+
+// 并行排序的一个片段
+typedef struct {
+    SortLine *lines;
+    int count;
+    const Filter *filter;
+} SortSlice;
+
+void sort_slice(void *arg) {
+    SortSlice *slice = arg;
+    qsort_r(slice->lines, slice->count, sizeof(SortLine), compare_sort_entries, (void *)slice->filter);
+}
+
+int sorter_init(Sorter *sorter, const Filter *filter, const char *delimiter) {
+    memset(sorter, 0, sizeof(*sorter));
+    sorter->filter = filter;
+    sorter->delimiter = delimiter;
+    sorter->memory_limit = (size_t)(filter->end > 0 ? filter->end : SORT_MEMORY_MB) * 1024 * 1024;
+    sorter->arena = malloc(sorter->memory_limit);
+    return sorter->arena != NULL;
+}
+
+void sorter_free(Sorter *sorter) {
+    for (int i = 0; i < sorter->run_count; i++) fclose(sorter->runs[i]);
+    free(sorter->runs);
+    free(sorter->lines);
+    free(sorter->arena);
+    workpool_destroy(sorter->pool);
+    memset(sorter, 0, sizeof(*sorter));
+}
+
+// 临时文件建在 $TMPDIR（默认 /tmp）下，创建后立即删除，关闭时自动释放空间
+FILE *create_run_file(void) {
+    const char *dir = getenv("TMPDIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/tkstream-sort-XXXXXX", dir && *dir ? dir : "/tmp");
+    
+    int fd = mkstemp(path);
+    if (fd < 0) return NULL;
+    unlink(path);
+    
+    FILE *file = fdopen(fd, "w+");
+    if (!file) {
+        close(fd);
+        return NULL;
+    }
+    setvbuf(file, NULL, _IOFBF, SORT_IO_BUFFER);
+    return file;
+}
+
+// 把当前一批分成若干片段并行排序，再归并到 out
+void sorter_sort_batch(Sorter *sorter, SortOutput *out) {
+    int slices = sorter->count / SORT_SLICE_MIN;
+    int cpus = workpool_cpu_count();
+    if (slices > cpus) slices = cpus;
+    if (slices < 1) slices = 1;
+    
+    SortSlice *tasks = malloc(slices * sizeof(SortSlice));
+    MergeSource *sources = calloc(slices, sizeof(MergeSource));
+    if (!tasks || !sources) {
+        // 内存不足时退回单线程排序
+        free(tasks);
+        free(sources);
+        SortSlice whole = {sorter->lines, sorter->count, sorter->filter};
+        sort_slice(&whole);
+        for (int i = 0; i < sorter->count; i++) {
+            if (!sort_output_line(out, sorter->lines[i].text, sorter->lines[i].length)) break;
+        }
+        return;
+    }
+    
+    for (int i = 0; i < slices; i++) {
+        int first = (int)((long long)sorter->count * i / slices);
+        int last = (int)((long long)sorter->count * (i + 1) / slices);
+        tasks[i].lines = sorter->lines + first;
+        tasks[i].count = last - first;
+        tasks[i].filter = sorter->filter;
+        sources[i].lines = tasks[i].lines;
+        sources[i].count = tasks[i].count;
+    }
+    
+    if (slices > 1 && !sorter->pool) {
+        sorter->pool = workpool_create(slices, 0);
+    }
+    if (slices > 1 && sorter->pool) {
+        for (int i = 0; i < slices; i++) workpool_submit(sorter->pool, sort_slice, &tasks[i]);
+        workpool_wait(sorter->pool);
+    } else {
+        for (int i = 0; i < slices; i++) sort_slice(&tasks[i]);
+    }
+    
+    merge_sources(sources, slices, sorter->filter, sorter->delimiter, out);
+    free(tasks);
+    free(sources);
+}
+
+// 归并一组临时文件，返回新的临时文件
+FILE *merge_run_files(FILE **runs, int count, const Filter *filter, const char *delimiter) {
+    FILE *merged = create_run_file();
+    MergeSource *sources = calloc(count, sizeof(MergeSource));
+    if (!merged || !sources) {
+        if (merged) fclose(merged);
+        free(sources);
+        return NULL;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        rewind(runs[i]);
+        sources[i].file = runs[i];
+    }
+    SortOutput out = {.file = merged, .limit = -1};
+    merge_sources(sources, count, filter, delimiter, &out);
+    
+    for (int i = 0; i < count; i++) free(sources[i].buffer);
+    free(sources);
+    if (fflush(merged) != 0) {
+        fclose(merged);
+        return NULL;
+    }
+    return merged;
+}
+
+// 当前一批排好序后写入临时文件；失败返回 0
+int sorter_spill(Sorter *sorter) {
+    if (sorter->run_count == sorter->run_capacity) {
+        int new_capacity = sorter->run_capacity ? sorter->run_capacity * 2 : 16;
+        FILE **runs = realloc(sorter->runs, new_capacity * sizeof(FILE *));
+        if (!runs) return 0;
+        sorter->runs = runs;
+        sorter->run_capacity = new_capacity;
+    }
+    
+    FILE *run = create_run_file();
+    if (!run) return 0;
+    
+    SortOutput out = {.file = run, .limit = -1};
+    sorter_sort_batch(sorter, &out);
+    if (fflush(run) != 0) {
+        fclose(run);
+        return 0;
+    }
+    
+    sorter->runs[sorter->run_count++] = run;
+    sorter->arena_used = 0;
+    sorter->count = 0;
+    return 1;
+}
+
+// 加入一行；内存达到上限时先把当前一批写入临时文件。失败返回 0
+int sorter_add(Sorter *sorter, const char *text, int length) {
+    size_t need = sorter->arena_used + length + 1 + (sorter->count + 1) * sizeof(SortLine);
+    if (need > sorter->memory_limit && sorter->count > 0 && !sorter_spill(sorter)) {
+        return 0;
+    }
+    if (sorter->arena_used + length + 1 > sorter->memory_limit) return 0;
+    
+    if (sorter->count == sorter->capacity) {
+        int new_capacity = sorter->capacity ? sorter->capacity * 2 : 10000;
+        SortLine *lines = realloc(sorter->lines, new_capacity * sizeof(SortLine));
+        if (!lines) return 0;
+        sorter->lines = lines;
+        sorter->capacity = new_capacity;
+    }
+    
+    char *copy = sorter->arena + sorter->arena_used;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    sorter->arena_used += length + 1;
+    
+    SortLine *line = &sorter->lines[sorter->count];
+    line->text = copy;
+    line->length = length;
+    line->seq = sorter->count++;
+    fill_sort_key(line, sorter->filter, sorter->delimiter);
+    return 1;
+}
+
+// 输出排序结果：全部在内存中时直接并行排序，否则把剩下的一批也写入临时文件后
+// 多路归并（临时文件太多时先分组归并）。失败返回 0
+int sorter_finish(Sorter *sorter, SortOutput *out) {
+    if (sorter->run_count == 0) {
+        sorter_sort_batch(sorter, out);
+        return 1;
+    }
+    if (sorter->count > 0 && !sorter_spill(sorter)) return 0;
+    
+    // 相邻的临时文件合并成一个，保持输入顺序，直到可以一次归并
+    while (sorter->run_count > SORT_MAX_MERGE) {
+        FILE *merged = merge_run_files(sorter->runs, SORT_MAX_MERGE, sorter->filter, sorter->delimiter);
+        if (!merged) return 0;
+        for (int i = 0; i < SORT_MAX_MERGE; i++) fclose(sorter->runs[i]);
+        sorter->runs[0] = merged;
+        memmove(sorter->runs + 1, sorter->runs + SORT_MAX_MERGE,
+                (sorter->run_count - SORT_MAX_MERGE) * sizeof(FILE *));
+        sorter->run_count -= SORT_MAX_MERGE - 1;
+    }
+    
+    MergeSource *sources = calloc(sorter->run_count, sizeof(MergeSource));
+    if (!sources) return 0;
+    for (int i = 0; i < sorter->run_count; i++) {
+        rewind(sorter->runs[i]);
+        sources[i].file = sorter->runs[i];
+    }
+    merge_sources(sources, sorter->run_count, sorter->filter, sorter->delimiter, out);
+    for (int i = 0; i < sorter->run_count; i++) free(sources[i].buffer);
+    free(sources);
+    return 1;
 }
 
 // 主处理函数
@@ -472,6 +1017,39 @@ void process_stream(Config *config, FILE *input, FILE *output) {
         all_lines = malloc(max_lines * sizeof(char *));
     }
     
+    // 第一个整体处理的过滤器是 uniq/count 时，读入时直接计数，重复的行不再保存
+    LineCounter counter;
+    line_counter_init(&counter);
+    int counting_filter = -1;
+    for (int i = 0; i < config->filter_count; i++) {
+        FilterType type = config->filters[i].type;
+        if (type == FILTER_UNIQ || type == FILTER_COUNT) {
+            counting_filter = i;
+            break;
+        }
+        if (type == FILTER_SORT || type == FILTER_TAIL || type == FILTER_HEAD ||
+            type == FILTER_REVERSE) {
+            break;
+        }
+    }
+    
+    // 第一个整体处理的过滤器是 sort 时，读入时直接交给排序器，超出内存上限的部分写入临时文件
+    Sorter sorter;
+    memset(&sorter, 0, sizeof(sorter));
+    int sorting_filter = -1;
+    for (int i = 0; i < config->filter_count && counting_filter < 0; i++) {
+        FilterType type = config->filters[i].type;
+        if (type == FILTER_SORT) {
+            if (sorter_init(&sorter, &config->filters[i], config->delimiter)) {
+                sorting_filter = i;
+            }
+            break;
+        }
+        if (type == FILTER_TAIL || type == FILTER_HEAD || type == FILTER_REVERSE) {
+            break;
+        }
+    }
+    
     // 跳过标题行
     if (config->skip_header && fgets(line, sizeof(line), input)) {
         line_count++;
@@ -558,7 +1136,17 @@ void process_stream(Config *config, FILE *input, FILE *output) {
         }
         
         if (keep_line) {
-            if (need_all_lines) {
+            if (counting_filter >= 0) {
+                if (!line_counter_add(&counter, current_line, strlen(current_line))) {
+                    print_error("内存不足");
+                    break;
+                }
+            } else if (sorting_filter >= 0) {
+                if (!sorter_add(&sorter, current_line, strlen(current_line))) {
+                    print_error("排序失败：内存不足或无法写入临时文件");
+                    break;
+                }
+            } else if (need_all_lines) {
                 if (all_lines_count >= max_lines) {
                     max_lines *= 2;
                     all_lines = realloc(all_lines, max_lines * sizeof(char *));
@@ -578,64 +1166,85 @@ void process_stream(Config *config, FILE *input, FILE *output) {
         }
     }
     
+    // sort 之后除 head 外没有别的整体处理时，归并结果直接写到输出，不再整体放进内存
+    if (sorting_filter >= 0) {
+        int direct = 1;
+        long long head_limit = -1;
+        for (int i = sorting_filter + 1; i < config->filter_count; i++) {
+            FilterType type = config->filters[i].type;
+            if (type == FILTER_HEAD && config->filters[i].end > 0) {
+                if (head_limit < 0 || config->filters[i].end < head_limit) {
+                    head_limit = config->filters[i].end;
+                }
+            } else if (type == FILTER_SORT || type == FILTER_UNIQ || type == FILTER_TAIL ||
+                       type == FILTER_REVERSE || type == FILTER_COUNT) {
+                direct = 0;
+            }
+        }
+        
+        if (direct) {
+            SortOutput out = {.file = output, .limit = head_limit};
+            if (!sorter_finish(&sorter, &out)) {
+                print_error("排序失败：内存不足或无法写入临时文件");
+            }
+            output_count += out.written;
+            sorter_free(&sorter);
+            sorting_filter = -1;
+            free(all_lines);
+            all_lines = NULL;
+            need_all_lines = 0;
+        }
+    }
+    
     // 处理需要所有数据的过滤器
-    if (need_all_lines && all_lines_count > 0) {
+    if (need_all_lines && (all_lines_count > 0 || counter.count > 0 ||
+                           sorter.count > 0 || sorter.run_count > 0)) {
         // 按顺序应用需要所有数据的过滤器
         for (int i = 0; i < config->filter_count; i++) {
             Filter *filter = &config->filters[i];
             
-            if (filter->type == FILTER_SORT) {
-                if (filter->numeric) {
-                    qsort(all_lines, all_lines_count, sizeof(char *), compare_strings_numeric);
-                } else {
-                    qsort(all_lines, all_lines_count, sizeof(char *), compare_strings);
+            if (filter->type == FILTER_UNIQ || filter->type == FILTER_COUNT) {
+                // 读入时没有计数的（前面有 sort 等），先把当前的行登记到计数表
+                if (i != counting_filter) {
+                    for (int j = 0; j < all_lines_count; j++) {
+                        if (!line_counter_add(&counter, all_lines[j], strlen(all_lines[j]))) {
+                            print_error("内存不足");
+                        }
+                        free(all_lines[j]);
+                    }
                 }
                 
-                if (filter->reverse) {
-                    // 反转数组
-                    for (int j = 0; j < all_lines_count / 2; j++) {
-                        char *temp = all_lines[j];
-                        all_lines[j] = all_lines[all_lines_count - 1 - j];
-                        all_lines[all_lines_count - 1 - j] = temp;
-                    }
+                char **counted = counter_to_lines(&counter, filter, &all_lines_count);
+                line_counter_free(&counter);
+                free(all_lines);
+                all_lines = counted;
+                if (!all_lines) {
+                    print_error("内存不足");
+                    all_lines_count = 0;
+                    break;
                 }
+                continue;
             }
-            else if (filter->type == FILTER_UNIQ) {
-                // 去重
-                int unique_count = 0;
-                for (int j = 0; j < all_lines_count; j++) {
-                    int is_duplicate = 0;
-                    for (int k = 0; k < unique_count; k++) {
-                        if (strcmp(all_lines[j], all_lines[k]) == 0) {
-                            is_duplicate = 1;
-                            if (filter->numeric) {
-                                // 计数模式
-                                char count_str[20];
-                                sprintf(count_str, "%d", atoi(all_lines[k]) + 1);
-                                free(all_lines[k]);
-                                all_lines[k] = strdup(count_str);
-                            }
-                            break;
-                        }
-                    }
-                    
-                    if (!is_duplicate) {
-                        if (filter->numeric) {
-                            // 计数模式，初始为1
-                            char count_str[20];
-                            sprintf(count_str, "1 %s", all_lines[j]);
-                            free(all_lines[j]);
-                            all_lines[j] = strdup(count_str);
-                        }
-                        if (unique_count != j) {
-                            all_lines[unique_count] = all_lines[j];
-                        }
-                        unique_count++;
-                    } else {
+            
+            if (filter->type == FILTER_SORT) {
+                // 读入时没有交给排序器的（前面有 uniq 等），先把当前的行交给排序器
+                int ok = 1;
+                if (i != sorting_filter) {
+                    ok = sorter_init(&sorter, filter, config->delimiter);
+                    for (int j = 0; j < all_lines_count; j++) {
+                        if (ok) ok = sorter_add(&sorter, all_lines[j], strlen(all_lines[j]));
                         free(all_lines[j]);
                     }
                 }
-                all_lines_count = unique_count;
+                
+                SortOutput out = {.limit = -1};
+                if (!ok || !sorter_finish(&sorter, &out)) {
+                    print_error("排序失败：内存不足或无法写入临时文件");
+                }
+                sorter_free(&sorter);
+                free(all_lines);
+                all_lines = out.lines;
+                all_lines_count = out.count;
             }
             else if (filter->type == FILTER_TAIL) {
                 int n = filter->end;
@@ -668,11 +1277,6 @@ void process_stream(Config *config, FILE *input, FILE *output) {
                     all_lines[all_lines_count - 1 - j] = temp;
                 }
             }
-            else if (filter->type == FILTER_COUNT) {
-                // 统计每行出现的次数
-                // 这里简化处理，只显示行数
-                // 实际应该统计每行的出现次数
-            }
             else if (filter->type == FILTER_WC) {
                 // 统计信息将在后面显示
             }
@@ -687,6 +1291,8 @@ void process_stream(Config *config, FILE *input, FILE *output) {
         
         free(all_lines);
     }
+    line_counter_free(&counter);
+    sorter_free(&sorter);
     
     clock_t end_time = clock();
     double elapsed = (double)(end_time - start_time) / CLOCKS_PER_SEC;
@@ -726,9 +1332,9 @@ int main(int argc, char *argv[]) {
         .column_output = 0
     };
     
-    // 解析选项
+    // 解析选项（"+" 使 getopt 在第一个过滤器处停止，过滤器自己的 -c、-n 等参数留给 parse_filter）
     int opt;
-    while ((opt = getopt(argc, argv, "i:o:d:Hb:vsh")) != -1) {
+    while ((opt = getopt(argc, argv, "+i:o:d:Hb:vsh")) != -1) {
         switch (opt) {
             case 'i':
                 strncpy(config.input_file, optarg, sizeof(config.input_file) - 1);
@@ -812,4 +1418,4 @@ int main(int argc, char *argv[]) {
     if (output != stdout) fclose(output);
     
     return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file